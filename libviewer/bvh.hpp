@@ -0,0 +1,499 @@
+#pragma once
+#include <queue>
+//
+#include <libviewer/intersection.hpp>
+#include <libviewer/thread_pool.hpp>
+
+namespace viewer {
+
+struct aabb {
+  constexpr auto center() const noexcept { return 0.5f * (min + max); }
+  constexpr auto size() const noexcept { return max - min; }
+
+  constexpr bool empty() const noexcept {
+    return (min.x > max.x) || (min.y > max.y) || (min.z > max.z);
+  }
+
+  constexpr auto surface_area() const noexcept -> float {
+    if (empty()) return 0.0f;
+    const auto s = size();
+    return 2.0f * (s.x * s.y + s.y * s.z + s.z * s.x);
+  }
+
+  auto extend(const vec3& p) noexcept -> aabb& {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+    return *this;
+  }
+
+  auto extend(const aabb& box) noexcept -> aabb& {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+    return *this;
+  }
+
+  vec3 min{INFINITY, INFINITY, INFINITY};
+  vec3 max{-INFINITY, -INFINITY, -INFINITY};
+};
+
+// Slab test for rays whose inverse direction has already been computed.
+// On success, 't' contains the entry distance of the ray into the box.
+inline bool intersect(const ray& r,
+                      const vec3& inverse_direction,
+                      const aabb& box,
+                      float t_max,
+                      float& t) noexcept {
+  const auto t1 = (box.min - r.origin) * inverse_direction;
+  const auto t2 = (box.max - r.origin) * inverse_direction;
+  const auto t_near = glm::min(t1, t2);
+  const auto t_far = glm::max(t1, t2);
+  t = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+  const auto f = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, t_max));
+  return t <= f;
+}
+
+// Bounding volume hierarchy over an arbitrary set of primitives
+// which are only known by their bounding boxes.
+// The tree is built top-down by using the binned surface area heuristic.
+// Child nodes are stored pairwise, so an inner node only needs
+// to know the index of its first child.
+// Children are always stored behind their parent.
+// For moving primitives, the tree can be refitted bottom-up.
+// Refitting keeps the topology and therefore slowly degrades its quality
+// which is tracked by the SAH cost relative to the one after the last build.
+struct bvh {
+  static constexpr size_t bin_count = 16;
+  static constexpr size_t max_leaf_size = 4;
+  static constexpr size_t max_depth = 64;
+  // Nodes up to this size are built by their own parallel task.
+  static constexpr size_t parallel_size = size_t{1} << 12;
+  static constexpr float traversal_cost = 1.0f;
+  static constexpr float intersection_cost = 1.0f;
+
+  struct node {
+    bool leaf() const noexcept { return count != 0; }
+
+    aabb box{};
+    // Index of the first child for inner nodes
+    // and index of the first primitive for leaves.
+    uint32 offset{};
+    // Number of primitives. Inner nodes have a count of zero.
+    uint32 count{};
+  };
+
+  bool empty() const noexcept { return nodes.empty(); }
+
+  void clear() noexcept {
+    nodes.clear();
+    primitives.clear();
+    parents.clear();
+    leaves.clear();
+    weighted_area = 0.0;
+    build_cost = 0.0f;
+  }
+
+  void build(const vector<aabb>& bounds) {
+    clear();
+    if (bounds.empty()) return;
+
+    primitives.resize(bounds.size());
+    for (uint32 i = 0; i < primitives.size(); ++i) primitives[i] = i;
+
+    nodes.reserve(2 * bounds.size());
+    nodes.push_back({{}, 0, uint32(bounds.size())});
+
+    // The upper levels are split sequentially. Smaller nodes are deferred.
+    // Their subtrees work on disjoint ranges of primitives
+    // and are built in parallel into local node arrays.
+    vector<pair<uint32, size_t>> subtrees{};
+    vector<pair<uint32, size_t>> stack{{0, 0}};
+    while (!stack.empty()) {
+      const auto [index, depth] = stack.back();
+      stack.pop_back();
+      if (nodes[index].count <= parallel_size) {
+        subtrees.push_back({index, depth});
+        continue;
+      }
+      if (!split(nodes, index, depth, bounds)) continue;
+      const auto first = nodes[index].offset;
+      stack.push_back({first + 1, depth + 1});
+      stack.push_back({first, depth + 1});
+    }
+
+    vector<vector<node>> trees(subtrees.size());
+    parallel_for(0, subtrees.size(), [&](size_t i) {
+      const auto [index, depth] = subtrees[i];
+      trees[i] = build(nodes[index], depth, bounds);
+    });
+
+    // The local root replaces its deferred node and all other local nodes
+    // are appended. So, local child indices only need to be shifted.
+    for (size_t i = 0; i < trees.size(); ++i) {
+      const auto shift = uint32(nodes.size() - 1);
+      for (auto& n : trees[i])
+        if (!n.leaf()) n.offset += shift;
+      nodes[subtrees[i].first] = trees[i][0];
+      nodes.insert(nodes.end(), trees[i].begin() + 1, trees[i].end());
+    }
+
+    parents.assign(nodes.size(), 0);
+    leaves.resize(primitives.size());
+    weighted_area = 0.0;
+    for (uint32 i = 0; i < nodes.size(); ++i) {
+      weighted_area += weight(nodes[i]) * nodes[i].box.surface_area();
+      if (!nodes[i].leaf()) {
+        parents[nodes[i].offset] = i;
+        parents[nodes[i].offset + 1] = i;
+        continue;
+      }
+      for (auto j = nodes[i].offset; j < nodes[i].offset + nodes[i].count; ++j)
+        leaves[primitives[j]] = i;
+    }
+    build_cost = cost();
+  }
+
+  // SAH cost of the tree given by the weighted sum of the node areas
+  // relative to the area of the root.
+  auto cost() const noexcept -> float {
+    if (nodes.empty()) return 0.0f;
+    const auto area = nodes[0].box.surface_area();
+    return (area > 0.0f) ? float(weighted_area / area) : 0.0f;
+  }
+
+  // Ratio of the current cost to the cost after the last build.
+  auto degradation() const noexcept -> float {
+    return (build_cost > 0.0f) ? cost() / build_cost : 1.0f;
+  }
+
+  // Rename primitives such that the primitive 'i' becomes 'map[i]'.
+  // The tree itself stays unchanged.
+  void remap(const auto& map) {
+    vector<uint32> remapped(leaves.size());
+    for (auto& p : primitives) {
+      remapped[map[p]] = leaves[p];
+      p = map[p];
+    }
+    leaves = move(remapped);
+  }
+
+  // Recompute the boxes of all nodes bottom-up.
+  // 'bounds(primitive)' has to return the current box of the primitive.
+  void refit(auto&& bounds) {
+    for (auto i = nodes.size(); i-- > 0;) update(uint32(i), bounds);
+  }
+
+  // Recompute only the boxes of nodes containing one of the changed primitives.
+  // As children are stored behind their parents, processing nodes
+  // in descending order visits all children before their parent.
+  // Parents whose children kept their boxes are not visited at all.
+  void refit(auto&& bounds, const vector<uint32>& changed) {
+    priority_queue<uint32> queue{};
+    for (auto p : changed) queue.push(leaves[p]);
+    while (!queue.empty()) {
+      const auto index = queue.top();
+      do queue.pop();
+      while (!queue.empty() && (queue.top() == index));
+      if (update(index, bounds) && (index != 0)) queue.push(parents[index]);
+    }
+  }
+
+  // Find the closest hit along the given ray.
+  // For every leaf primitive whose node box is not further away than 't_max',
+  // the callback 'f(primitive, t_max)' is called.
+  // The callback has to decrease 't_max' when it finds a closer hit.
+  void traverse(const ray& r, float& t_max, auto&& f) const {
+    traverse_leaves(r, t_max, [&](const node& leaf, float& t_max) {
+      for (auto i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+        f(primitives[i], t_max);
+    });
+  }
+
+  // Like 'traverse' but the callback 'f(leaf, t_max)' receives whole leaves.
+  // Their primitives are given by 'primitives[leaf.offset + i]'
+  // for all 'i' less than 'leaf.count'.
+  void traverse_leaves(const ray& r, float& t_max, auto&& f) const {
+    if (nodes.empty()) return;
+    const auto inverse_direction = 1.0f / r.direction;
+
+    float t;
+    if (!intersect(r, inverse_direction, nodes[0].box, t_max, t)) return;
+
+    pair<uint32, float> stack[max_depth + 1];
+    size_t top = 0;
+    stack[top++] = {0, t};
+
+    while (top) {
+      const auto [index, t_near] = stack[--top];
+      if (t_near >= t_max) continue;
+
+      const auto& n = nodes[index];
+      if (n.leaf()) {
+        f(n, t_max);
+        continue;
+      }
+
+      float t1, t2;
+      const auto hit1 =
+          intersect(r, inverse_direction, nodes[n.offset].box, t_max, t1);
+      const auto hit2 =
+          intersect(r, inverse_direction, nodes[n.offset + 1].box, t_max, t2);
+
+      // Push the farther child first so that the nearer one is visited next.
+      if (hit1 && hit2) {
+        if (t1 <= t2) {
+          stack[top++] = {n.offset + 1, t2};
+          stack[top++] = {n.offset, t1};
+        } else {
+          stack[top++] = {n.offset, t1};
+          stack[top++] = {n.offset + 1, t2};
+        }
+      } else if (hit1)
+        stack[top++] = {n.offset, t1};
+      else if (hit2)
+        stack[top++] = {n.offset + 1, t2};
+    }
+  }
+
+  // Packet variant of 'traverse' for coherent rays. Every ray has its own
+  // 't_max' and the callback 'f(primitive, t_max)' decreases its entries.
+  template <size_t N>
+  void traverse(const ray_packet<N>& rays, float (&t_max)[N], auto&& f) const {
+    traverse_leaves(rays, t_max, [&](const node& leaf, float(&t_max)[N]) {
+      for (auto i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+        f(primitives[i], t_max);
+    });
+  }
+
+  // A node is visited as long as one of the rays hits its box
+  // before its own 't_max'. Children are ordered by their nearest entry.
+  template <size_t N>
+  void traverse_leaves(const ray_packet<N>& rays,
+                       float (&t_max)[N],
+                       auto&& f) const {
+    if (nodes.empty()) return;
+    float inverse_direction[3][N];
+    for (int k = 0; k < 3; ++k)
+      for (size_t i = 0; i < N; ++i)
+        inverse_direction[k][i] = 1.0f / rays.direction[k][i];
+    // Nearest entry of all rays or infinity if none hits the box.
+    // The slab test runs branch-free over the lanes to be vectorized.
+    const auto entry = [&](const aabb& box) {
+      float t_near[N];
+      float t_far[N];
+      for (size_t i = 0; i < N; ++i) {
+        t_near[i] = 0.0f;
+        t_far[i] = t_max[i];
+      }
+      for (int k = 0; k < 3; ++k) {
+        for (size_t i = 0; i < N; ++i) {
+          const auto t1 =
+              (box.min[k] - rays.origin[k][i]) * inverse_direction[k][i];
+          const auto t2 =
+              (box.max[k] - rays.origin[k][i]) * inverse_direction[k][i];
+          t_near[i] = std::max(t_near[i], std::min(t1, t2));
+          t_far[i] = std::min(t_far[i], std::max(t1, t2));
+        }
+      }
+      float result = INFINITY;
+      for (size_t i = 0; i < N; ++i)
+        if (t_near[i] <= t_far[i]) result = std::min(result, t_near[i]);
+      return result;
+    };
+    const auto farthest = [&] { return *ranges::max_element(t_max); };
+
+    const auto t = entry(nodes[0].box);
+    if (t == INFINITY) return;
+
+    pair<uint32, float> stack[max_depth + 1];
+    size_t top = 0;
+    stack[top++] = {0, t};
+
+    while (top) {
+      const auto [index, t_near] = stack[--top];
+      if (t_near >= farthest()) continue;
+
+      const auto& n = nodes[index];
+      if (n.leaf()) {
+        f(n, t_max);
+        continue;
+      }
+
+      const auto t1 = entry(nodes[n.offset].box);
+      const auto t2 = entry(nodes[n.offset + 1].box);
+      const auto hit1 = t1 != INFINITY;
+      const auto hit2 = t2 != INFINITY;
+      if (hit1 && hit2) {
+        if (t1 <= t2) {
+          stack[top++] = {n.offset + 1, t2};
+          stack[top++] = {n.offset, t1};
+        } else {
+          stack[top++] = {n.offset, t1};
+          stack[top++] = {n.offset + 1, t2};
+        }
+      } else if (hit1)
+        stack[top++] = {n.offset, t1};
+      else if (hit2)
+        stack[top++] = {n.offset + 1, t2};
+    }
+  }
+
+  vector<node> nodes{};
+  // Permutation of primitive indices referenced by the leaves.
+  vector<uint32> primitives{};
+  // Parent index for every node. The root is its own parent.
+  vector<uint32> parents{};
+  // Leaf index for every primitive
+  vector<uint32> leaves{};
+
+ private:
+  static auto weight(const node& n) noexcept -> double {
+    return n.leaf() ? intersection_cost * n.count : traversal_cost;
+  }
+
+  // Recompute the box of the given node from its primitives or children
+  // and return whether it has changed.
+  bool update(uint32 index, auto&& bounds) {
+    auto& n = nodes[index];
+    aabb box{};
+    if (n.leaf()) {
+      for (auto i = n.offset; i < n.offset + n.count; ++i)
+        box.extend(bounds(primitives[i]));
+    } else {
+      box.extend(nodes[n.offset].box).extend(nodes[n.offset + 1].box);
+    }
+    if ((box.min == n.box.min) && (box.max == n.box.max)) return false;
+    weighted_area +=
+        weight(n) * (double(box.surface_area()) - n.box.surface_area());
+    n.box = box;
+    return true;
+  }
+
+  // Build the subtree of the given node into a local array
+  // whose first element is the root of the subtree.
+  auto build(const node& root, size_t depth, const vector<aabb>& bounds)
+      -> vector<node> {
+    vector<node> tree{root};
+    vector<pair<uint32, size_t>> stack{{0, depth}};
+    while (!stack.empty()) {
+      const auto [index, depth] = stack.back();
+      stack.pop_back();
+      if (!split(tree, index, depth, bounds)) continue;
+      const auto first = tree[index].offset;
+      stack.push_back({first + 1, depth + 1});
+      stack.push_back({first, depth + 1});
+    }
+    return tree;
+  }
+
+  // Try to split the given node by the binned surface area heuristic.
+  // Returns false if the node has been kept as a leaf.
+  bool split(vector<node>& tree,
+             uint32 index,
+             size_t depth,
+             const vector<aabb>& bounds) {
+    const auto first = tree[index].offset;
+    const auto count = tree[index].count;
+
+    aabb box{};
+    aabb centers{};
+    for (auto i = first; i < first + count; ++i) {
+      box.extend(bounds[primitives[i]]);
+      centers.extend(bounds[primitives[i]].center());
+    }
+    tree[index].box = box;
+
+    if (count <= 1 || depth >= max_depth) return false;
+
+    struct bin {
+      aabb box{};
+      size_t count = 0;
+    };
+
+    const auto extent = centers.size();
+    float best_cost = INFINITY;
+    int best_axis = -1;
+    size_t best_split = 0;
+
+    for (int axis = 0; axis < 3; ++axis) {
+      if (extent[axis] <= 0.0f) continue;
+      const auto scale = bin_count / extent[axis];
+      const auto bin_index = [&](uint32 p) {
+        const auto b =
+            size_t(scale * (bounds[p].center()[axis] - centers.min[axis]));
+        return std::min(b, bin_count - 1);
+      };
+
+      bin bins[bin_count]{};
+      for (auto i = first; i < first + count; ++i) {
+        auto& b = bins[bin_index(primitives[i])];
+        b.box.extend(bounds[primitives[i]]);
+        ++b.count;
+      }
+
+      // Sweep from the right to accumulate the costs of all right sides.
+      float right_area[bin_count]{};
+      size_t right_count[bin_count]{};
+      {
+        aabb b{};
+        size_t c = 0;
+        for (size_t i = bin_count - 1; i > 0; --i) {
+          b.extend(bins[i].box);
+          c += bins[i].count;
+          right_area[i] = b.surface_area();
+          right_count[i] = c;
+        }
+      }
+
+      aabb b{};
+      size_t c = 0;
+      for (size_t i = 1; i < bin_count; ++i) {
+        b.extend(bins[i - 1].box);
+        c += bins[i - 1].count;
+        if (c == 0 || right_count[i] == 0) continue;
+        const auto cost =
+            b.surface_area() * c + right_area[i] * right_count[i];
+        if (cost >= best_cost) continue;
+        best_cost = cost;
+        best_axis = axis;
+        best_split = i;
+      }
+    }
+
+    const auto leaf_cost = intersection_cost * count;
+    const auto area = box.surface_area();
+    best_cost = traversal_cost +
+                intersection_cost * best_cost / ((area > 0.0f) ? area : 1.0f);
+    if ((best_cost >= leaf_cost) && (count <= max_leaf_size)) return false;
+
+    uint32 middle;
+    if (best_axis >= 0) {
+      const auto axis = best_axis;
+      const auto scale = bin_count / extent[axis];
+      const auto it = std::partition(
+          &primitives[first], &primitives[first] + count, [&](uint32 p) {
+            const auto b =
+                size_t(scale * (bounds[p].center()[axis] - centers.min[axis]));
+            return std::min(b, bin_count - 1) < best_split;
+          });
+      middle = uint32(it - primitives.data());
+    } else {
+      // All centers coincide and cannot be separated by a plane.
+      // Large nodes are still split in halves to bound the leaf size.
+      if (count <= max_leaf_size) return false;
+      middle = first + count / 2;
+    }
+
+    const auto children = uint32(tree.size());
+    tree[index].offset = children;
+    tree[index].count = 0;
+    tree.push_back({{}, first, middle - first});
+    tree.push_back({{}, middle, first + count - middle});
+    return true;
+  }
+
+  // Accumulated SAH weights times areas of all nodes
+  double weighted_area = 0.0;
+  float build_cost = 0.0f;
+};
+
+}  // namespace viewer
@@ -0,0 +1,51 @@
+#pragma once
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Bounding sphere and normal cone of a set of faces.
+// The cone contains the normals of all faces.
+// Its cutoff is the sine of the smallest angle between the axis
+// and the normals, or one if the cone opens wider than a half space.
+struct bounding_cone {
+  vec3 center{};
+  float radius{};
+  vec3 axis{0, 0, 1};
+  float cutoff = 1.0f;
+};
+
+// The six planes of a view frustum with normals pointing inwards.
+// Planes are extracted from a transform into clip space
+// by the method of Gribb and Hartmann. Passing the complete transform
+// 'projection * view * model' gives planes in object space.
+struct frustum {
+  frustum() = default;
+
+  explicit frustum(const mat4& m) noexcept {
+    const auto row = [&](int i) {
+      return vec4{m[0][i], m[1][i], m[2][i], m[3][i]};
+    };
+    for (int i = 0; i < 3; ++i) {
+      planes[2 * i] = row(3) + row(i);
+      planes[2 * i + 1] = row(3) - row(i);
+    }
+    for (auto& p : planes) p /= length(vec3(p));
+  }
+
+  // Conservative test for spheres which are completely outside.
+  bool outside(const vec3& center, float radius) const noexcept {
+    for (const auto& p : planes)
+      if (dot(vec3(p), center) + p.w < -radius) return true;
+    return false;
+  }
+
+  vec4 planes[6]{};
+};
+
+// Conservative test for clusters whose faces all point away from 'eye'.
+inline bool backfacing(const bounding_cone& cone, const vec3& eye) noexcept {
+  const auto d = cone.center - eye;
+  return dot(d, cone.axis) >= cone.cutoff * length(d) + cone.radius;
+}
+
+}  // namespace viewer
@@ -1,10 +1,11 @@
 #pragma once
+#include <libviewer/packed_vertex_shader.hpp>
 #include <libviewer/utility.hpp>
 
 namespace viewer {
 
 inline auto default_shader() -> shader_program {
-  constexpr czstring vertex_shader_text =
+  const auto vertex_shader_text =
       "#version 330 core\n"
 
       "struct Camera {"
@@ -18,8 +19,8 @@ inline auto default_shader() -> shader_program {
 
       "layout (location = 0) in vec3 p;"
       "layout (location = 1) in vec3 n;"
-      "layout (location = 2) in vec2 uv;"
-
+      "layout (location = 2) in vec2 uv;"s +
+      packed_vertex_shader_text +
       // "out vec3 normal;"
       // "out vec2 texuv;"
 
@@ -29,8 +30,11 @@ inline auto default_shader() -> shader_program {
       "} v;"
 
       "void main(){"
-      "  gl_Position = camera.projection * camera.view * model * vec4(p, 1.0);"
-      "  v.normal = vec3(camera.view * model * vec4(n, 0.0));"
+      "  vec3 vertex_position = unpack_position(p);"
+      "  vec3 vertex_normal = unpack_normal(n);"
+      "  gl_Position = camera.projection * camera.view * model *"
+      "                vec4(vertex_position, 1.0);"
+      "  v.normal = vec3(camera.view * model * vec4(vertex_normal, 0.0));"
       "  v.texuv = uv;"
       "}";
 
@@ -80,7 +84,7 @@ inline auto default_shader() -> shader_program {
 
       "}";
 
-  return shader_program{vertex_shader_text, fragment_shader_text};
+  return shader_program{vertex_shader_text.c_str(), fragment_shader_text};
 }
 
 }  // namespace viewer
@@ -0,0 +1,164 @@
+#pragma once
+#include <libviewer/sparse_cholesky.hpp>
+#include <libviewer/thread_pool.hpp>
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Geodesic distances by the heat method of Crane, Weischedel and Wardetzky,
+// 'Geodesics in Heat', 2013. Heat diffused from the sources for a short time
+// is normalized to a unit vector field pointing away from them.
+// Distances are the potential whose gradient fits this field best.
+// Both linear systems only depend on the geometry and are factorized once.
+// So, every query costs two forward and backward substitutions.
+class heat_method {
+ public:
+  using face = array<uint32, 3>;
+
+  bool empty() const noexcept { return heat.empty(); }
+  auto factor_nonzeros() const noexcept {
+    return heat.nonzeros() + poisson.nonzeros();
+  }
+
+  // Assemble the cotangent Laplacian 'L' and the lumped mass matrix 'M'.
+  // The heat flows for the time 't = time_factor * h^2' where 'h' is
+  // the mean edge length. So, 'M + t L' is factorized for the diffusion.
+  // 'L' is only semidefinite and gets a tiny multiple of 'M' added.
+  // Returns false if a factorization fails.
+  template <typename F>
+  bool build(const vector<vec3>& positions,
+             const vector<F>& mesh_faces,
+             float time_factor = 1.0f) {
+    const auto n = positions.size();
+    faces.resize(mesh_faces.size());
+    areas.assign(mesh_faces.size(), 0.0f);
+    gradients.assign(mesh_faces.size(), {});
+    masses.assign(n, 0.0);
+
+    double edge_length = 0;
+    vector<sparse_matrix::entry> entries{};
+    entries.reserve(9 * faces.size() + n);
+    for (size_t f = 0; f < faces.size(); ++f) {
+      for (int k = 0; k < 3; ++k) faces[f][k] = mesh_faces[f][k];
+      const auto& [a, b, c] = faces[f];
+      const vec3 edges[3] = {positions[c] - positions[b],
+                             positions[a] - positions[c],
+                             positions[b] - positions[a]};
+      for (const auto& e : edges) edge_length += length(e);
+      const auto m = cross(edges[2], -edges[1]);
+      const auto twice_area = length(m);
+      if (twice_area == 0.0f) continue;
+      // Gradients of the barycentric coordinates are the edges
+      // opposite to their vertices rotated into the face.
+      const auto normal = m / twice_area;
+      for (int k = 0; k < 3; ++k)
+        gradients[f][k] = cross(normal, edges[k]) / twice_area;
+      areas[f] = twice_area / 2;
+      // The stiffness 'area * dot(g_i, g_j)' equals the cotangent weights.
+      // Diagonals are the negated sums of their rows. So, constants are
+      // in the kernel up to rounding and the shift stays positive.
+      for (int i = 0; i < 3; ++i) {
+        masses[faces[f][i]] += areas[f] / 3;
+        for (int j = i + 1; j < 3; ++j) {
+          const auto w =
+              double(areas[f]) * dot(gradients[f][i], gradients[f][j]);
+          entries.push_back({faces[f][i], faces[f][j], w});
+          entries.push_back({faces[f][i], faces[f][i], -w});
+          entries.push_back({faces[f][j], faces[f][j], -w});
+        }
+      }
+    }
+    // Every row gets a diagonal entry even for unreferenced vertices.
+    for (uint32 i = 0; i < n; ++i) entries.push_back({i, i, 0.0});
+    const sparse_matrix laplacian{n, move(entries)};
+
+    const auto h = edge_length / std::max<size_t>(3 * faces.size(), 1);
+    time = time_factor * h * h;
+    const auto shift = 1e-10 / (h * h);
+    auto diffusion = laplacian;
+    auto potential = laplacian;
+    for (auto& x : diffusion.values) x *= time;
+    for (uint32 i = 0; i < n; ++i) {
+      const auto p = laplacian.diagonal(i);
+      if (masses[i] > 0.0) {
+        diffusion.values[p] += masses[i];
+        potential.values[p] += shift * masses[i];
+        continue;
+      }
+      // Unreferenced vertices are decoupled by a unit diagonal.
+      diffusion.values[p] = 1.0;
+      potential.values[p] = 1.0;
+    }
+
+    // Both factorizations share the order but are independent otherwise.
+    const auto order = nested_dissection(laplacian, positions);
+    bool success[2]{};
+    parallel_for(0, 2, [&](size_t i) {
+      success[i] = (i == 0) ? heat.factorize(diffusion, order)
+                            : poisson.factorize(potential, order);
+    });
+    return success[0] && success[1];
+  }
+
+  // Distances of all vertices to the closest source.
+  // Vertices not connected to any source get meaningless values.
+  auto distances(const auto& sources) const -> vector<float> {
+    const auto n = masses.size();
+    vector<double> u(n, 0.0);
+    for (auto s : sources) u[s] = 1.0;
+    heat.solve(u);
+
+    // The potential minimizes the squared difference of its gradient
+    // and the normalized field. So, the right-hand side is the integral
+    // of the field against the gradients of the hat functions.
+    vector<double> b(n, 0.0);
+    for (size_t f = 0; f < faces.size(); ++f) {
+      if (areas[f] == 0.0f) continue;
+      const auto& g = gradients[f];
+      const auto& [x, y, z] = faces[f];
+      // Heat decays exponentially with the distance and underflows
+      // in single precision. Only its direction is needed.
+      const auto grad = u[x] * glm::dvec3(g[0]) + u[y] * glm::dvec3(g[1]) +
+                        u[z] * glm::dvec3(g[2]);
+      const auto l = glm::length(grad);
+      if (l == 0.0) continue;
+      const auto field = vec3(-grad / l);
+      for (int k = 0; k < 3; ++k)
+        b[faces[f][k]] += double(areas[f]) * dot(g[k], field);
+    }
+    poisson.solve(b);
+
+    auto offset = double(INFINITY);
+    for (auto s : sources) offset = std::min(offset, b[s]);
+    vector<float> result(n);
+    for (size_t i = 0; i < n; ++i) result[i] = b[i] - offset;
+    return result;
+  }
+
+  // Gradients of the barycentric coordinates of a face.
+  // They are zero for degenerate faces.
+  auto barycentric_gradients(uint32 f) const noexcept
+      -> const array<vec3, 3>& {
+    return gradients[f];
+  }
+
+  // Gradient of the linear interpolation of vertex values over a face
+  auto gradient(uint32 f, const vector<float>& values) const noexcept
+      -> vec3 {
+    const auto& g = gradients[f];
+    const auto& [x, y, z] = faces[f];
+    return values[x] * g[0] + values[y] * g[1] + values[z] * g[2];
+  }
+
+  float time{};
+
+ private:
+  vector<face> faces{};
+  vector<float> areas{};
+  vector<array<vec3, 3>> gradients{};
+  vector<double> masses{};
+  sparse_cholesky heat{};
+  sparse_cholesky poisson{};
+};
+
+}  // namespace viewer
@@ -0,0 +1,123 @@
+#pragma once
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Min-heap over the indices [0, n) ordered by keys with decrease-key.
+// Every index is contained at most once and its position in the heap
+// is stored. So, keys can be decreased in place instead of pushing
+// duplicates as with 'ranges::push_heap'. The arity 'D' trades
+// the depth of the heap against comparisons per level. Four children
+// are a good fit for the frequent decrease-key of graph searches.
+template <unsigned_integral I = uint32, typename K = float, size_t D = 4>
+class indexed_heap {
+ public:
+  using index_type = I;
+  using key_type = K;
+  static constexpr index_type npos = -1;
+
+  indexed_heap() = default;
+  explicit indexed_heap(size_t n) : positions(n, npos) {}
+
+  // Remove all indices and allow at least the indices in [0, n).
+  // Only positions of contained indices are reset.
+  // So, reusing a heap costs time proportional to its last use.
+  void reset(size_t n) {
+    clear();
+    if (positions.size() < n) positions.resize(n, npos);
+  }
+
+  void clear() noexcept {
+    for (const auto& x : nodes) positions[x.index] = npos;
+    nodes.clear();
+  }
+
+  bool empty() const noexcept { return nodes.empty(); }
+  auto size() const noexcept { return nodes.size(); }
+  bool contains(index_type i) const noexcept { return positions[i] != npos; }
+
+  auto top() const noexcept { return nodes[0].index; }
+  auto top_key() const noexcept { return nodes[0].key; }
+  auto key(index_type i) const noexcept { return nodes[positions[i]].key; }
+
+  void push(index_type i, key_type k) {
+    positions[i] = nodes.size();
+    nodes.push_back({k, i});
+    sift_up(nodes.size() - 1);
+  }
+
+  // The new key must not be greater than the current one.
+  void decrease(index_type i, key_type k) noexcept {
+    const auto p = positions[i];
+    nodes[p].key = k;
+    sift_up(p);
+  }
+
+  // Insert the index or decrease its key.
+  // Returns false if the contained key is already smaller or equal.
+  bool push_or_decrease(index_type i, key_type k) {
+    if (!contains(i)) {
+      push(i, k);
+      return true;
+    }
+    if (!(k < key(i))) return false;
+    decrease(i, k);
+    return true;
+  }
+
+  auto pop() noexcept -> index_type {
+    const auto result = nodes[0].index;
+    positions[result] = npos;
+    const auto last = nodes.back();
+    nodes.pop_back();
+    if (!nodes.empty()) {
+      nodes[0] = last;
+      positions[last.index] = 0;
+      sift_down(0);
+    }
+    return result;
+  }
+
+ private:
+  struct node {
+    key_type key;
+    index_type index;
+  };
+
+  void sift_up(size_t p) noexcept {
+    const auto x = nodes[p];
+    while (p > 0) {
+      const auto parent = (p - 1) / D;
+      if (!(x.key < nodes[parent].key)) break;
+      nodes[p] = nodes[parent];
+      positions[nodes[p].index] = p;
+      p = parent;
+    }
+    nodes[p] = x;
+    positions[x.index] = p;
+  }
+
+  void sift_down(size_t p) noexcept {
+    const auto x = nodes[p];
+    const auto n = nodes.size();
+    while (true) {
+      const auto first = D * p + 1;
+      if (first >= n) break;
+      const auto last = std::min(first + D, n);
+      auto child = first;
+      for (auto c = first + 1; c < last; ++c)
+        if (nodes[c].key < nodes[child].key) child = c;
+      if (!(nodes[child].key < x.key)) break;
+      nodes[p] = nodes[child];
+      positions[nodes[p].index] = p;
+      p = child;
+    }
+    nodes[p] = x;
+    positions[x.index] = p;
+  }
+
+  vector<node> nodes{};
+  vector<index_type> positions{};
+};
+
+}  // namespace viewer
@@ -1,5 +1,10 @@
 #pragma once
 #include <libviewer/utility.hpp>
+//
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LIBVIEWER_X86_64_INTRINSICS 1
+#include <immintrin.h>
+#endif
 
 namespace viewer {
 
@@ -18,6 +23,8 @@ struct intersection {
   float t = INFINITY;
 };
 
+// Möller–Trumbore test which rejects as soon as a barycentric coordinate
+// leaves the triangle. The result is only valid if 'true' is returned.
 inline bool intersect(const ray& r,
                       const triangle& t,
                       intersection& uvt) noexcept {
@@ -26,15 +33,40 @@ inline bool intersect(const ray& r,
 
   const auto p = cross(r.direction, edge2);
   const auto determinant = dot(edge1, p);
+  if (0.0f == determinant) return false;
   const auto inverse_determinant = 1.0f / determinant;
+
   const auto s = r.origin - t.vertex[0];
   uvt.u = dot(s, p) * inverse_determinant;
+  if (!(uvt.u >= 0.0f && uvt.u <= 1.0f)) return false;
+
   const auto q = cross(s, edge1);
   uvt.v = dot(r.direction, q) * inverse_determinant;
+  if (!(uvt.v >= 0.0f && uvt.u + uvt.v <= 1.0f)) return false;
+
   uvt.t = dot(edge2, q) * inverse_determinant;
+  return uvt.t > 0.0f;
+}
+
+// Intersection with the plane of the triangle.
+// Barycentric coordinates are not restricted to the triangle.
+inline bool intersect_plane(const ray& r,
+                            const triangle& t,
+                            intersection& uvt) noexcept {
+  const auto edge1 = t.vertex[1] - t.vertex[0];
+  const auto edge2 = t.vertex[2] - t.vertex[0];
+
+  const auto p = cross(r.direction, edge2);
+  const auto determinant = dot(edge1, p);
+  if (0.0f == determinant) return false;
+  const auto inverse_determinant = 1.0f / determinant;
 
-  return (0.0f != determinant) && (uvt.u >= 0.0f && uvt.u <= 1.0f) &&
-         (uvt.v >= 0.0f && uvt.u + uvt.v <= 1.0f) && (uvt.t > 0.0f);
+  const auto s = r.origin - t.vertex[0];
+  const auto q = cross(s, edge1);
+  uvt.u = dot(s, p) * inverse_determinant;
+  uvt.v = dot(r.direction, q) * inverse_determinant;
+  uvt.t = dot(edge2, q) * inverse_determinant;
+  return uvt.t > 0.0f;
 }
 
 inline auto voronoi_snap(const triangle& t, const vec3& x) noexcept -> size_t {
@@ -44,4 +76,518 @@ inline auto voronoi_snap(const triangle& t, const vec3& x) noexcept -> size_t {
   return (a <= b) ? ((a <= c) ? 0 : 2) : ((b <= c) ? 1 : 2);
 }
 
+// Instruction sets for the packet intersection kernels.
+// 'scalar' is always available and denotes the plain Möller–Trumbore test.
+enum class intersection_kernel { scalar, sse, avx2 };
+
+inline bool available(intersection_kernel kernel) noexcept {
+#ifdef LIBVIEWER_X86_64_INTRINSICS
+  switch (kernel) {
+    case intersection_kernel::sse:
+      return true;
+    case intersection_kernel::avx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+    default:
+      return true;
+  }
+#else
+  return kernel == intersection_kernel::scalar;
+#endif
+}
+
+inline auto default_intersection_kernel() noexcept -> intersection_kernel {
+  if (available(intersection_kernel::avx2)) return intersection_kernel::avx2;
+  if (available(intersection_kernel::sse)) return intersection_kernel::sse;
+  return intersection_kernel::scalar;
+}
+
+// The kernel used by mesh intersections.
+// It may be changed at runtime to compare the implementations.
+inline atomic<intersection_kernel> active_intersection_kernel =
+    default_intersection_kernel();
+
+inline auto intersection_kernel_name(intersection_kernel kernel) noexcept
+    -> czstring {
+  switch (kernel) {
+    case intersection_kernel::sse:
+      return "sse";
+    case intersection_kernel::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+// Pre-transposed triangles for the packet kernels.
+// Every triangle is stored by its first vertex and its two edges
+// with each coordinate in its own contiguous array.
+// Arrays are padded such that windows of up to 'padding' triangles
+// can be loaded at any valid index.
+struct triangle_soa {
+  static constexpr size_t padding = 8;
+
+  auto size() const noexcept { return count; }
+
+  void clear() noexcept { resize(0); }
+
+  void resize(size_t n) {
+    count = n;
+    for (size_t k = 0; k < 3; ++k) {
+      v0[k].assign(n + padding, 0.0f);
+      e1[k].assign(n + padding, 0.0f);
+      e2[k].assign(n + padding, 0.0f);
+    }
+  }
+
+  void set(size_t i, const triangle& t) noexcept {
+    const auto edge1 = t.vertex[1] - t.vertex[0];
+    const auto edge2 = t.vertex[2] - t.vertex[0];
+    for (int k = 0; k < 3; ++k) {
+      v0[k][i] = t.vertex[0][k];
+      e1[k][i] = edge1[k];
+      e2[k][i] = edge2[k];
+    }
+  }
+
+  auto operator[](size_t i) const noexcept -> triangle {
+    const vec3 a{v0[0][i], v0[1][i], v0[2][i]};
+    const vec3 b{e1[0][i], e1[1][i], e1[2][i]};
+    const vec3 c{e2[0][i], e2[1][i], e2[2][i]};
+    return {a, a + b, a + c};
+  }
+
+  size_t count = 0;
+  vector<float> v0[3]{};
+  vector<float> e1[3]{};
+  vector<float> e2[3]{};
+};
+
+// Rays in SoA layout to be tested against a single triangle at once.
+template <size_t N>
+struct ray_packet {
+  static constexpr size_t size = N;
+
+  void set(size_t i, const ray& r) noexcept {
+    for (int k = 0; k < 3; ++k) {
+      origin[k][i] = r.origin[k];
+      direction[k][i] = r.direction[k];
+    }
+  }
+
+  alignas(32) float origin[3][N]{};
+  alignas(32) float direction[3][N]{};
+};
+
+template <size_t N>
+struct intersection_packet {
+  static constexpr size_t size = N;
+
+  alignas(32) float u[N]{};
+  alignas(32) float v[N]{};
+  alignas(32) float t[N]{};
+
+  intersection_packet() noexcept {
+    for (size_t i = 0; i < N; ++i) t[i] = INFINITY;
+  }
+};
+
+namespace detail {
+
+// Select the closest lane of the given hit mask and store its values.
+inline auto closest_lane(unsigned mask,
+                         const float* u,
+                         const float* v,
+                         const float* t,
+                         intersection& uvt) noexcept -> int {
+  int result = -1;
+  for (int i = 0; mask; ++i, mask >>= 1) {
+    if (!(mask & 1u) || !(t[i] < uvt.t)) continue;
+    uvt = {u[i], v[i], t[i]};
+    result = i;
+  }
+  return result;
+}
+
+}  // namespace detail
+
+// Test the triangles [first, first + count) against one ray.
+// Returns the index of the closest triangle that is nearer than 'uvt.t'
+// and updates 'uvt'. Otherwise, 'size_t(-1)' is returned.
+inline auto intersect_scalar(const ray& r,
+                             const triangle_soa& triangles,
+                             size_t first,
+                             size_t count,
+                             intersection& uvt) noexcept -> size_t {
+  size_t result = -1;
+  for (auto i = first; i < first + count; ++i) {
+    intersection tmp{};
+    if (!intersect(r, triangles[i], tmp)) continue;
+    if (tmp.t >= uvt.t) continue;
+    uvt = tmp;
+    result = i;
+  }
+  return result;
+}
+
+template <size_t N>
+inline auto intersect_scalar(const ray_packet<N>& rays,
+                             const triangle& t,
+                             intersection_packet<N>& uvt) noexcept
+    -> unsigned {
+  unsigned mask = 0;
+  for (size_t i = 0; i < N; ++i) {
+    const ray r{{rays.origin[0][i], rays.origin[1][i], rays.origin[2][i]},
+                {rays.direction[0][i], rays.direction[1][i],
+                 rays.direction[2][i]}};
+    intersection tmp{};
+    if (!intersect(r, t, tmp)) continue;
+    if (tmp.t >= uvt.t[i]) continue;
+    uvt.u[i] = tmp.u;
+    uvt.v[i] = tmp.v;
+    uvt.t[i] = tmp.t;
+    mask |= 1u << i;
+  }
+  return mask;
+}
+
+#ifdef LIBVIEWER_X86_64_INTRINSICS
+
+// The SSE and AVX2 kernels share their structure.
+// Both evaluate Möller–Trumbore for all lanes at once
+// and leave early when no lane survives a barycentric test.
+// Inactive lanes are masked out by the lane count.
+
+inline auto intersect_sse(const ray& r,
+                          const triangle_soa& triangles,
+                          size_t first,
+                          size_t count,
+                          intersection& uvt) noexcept -> size_t {
+  const auto load = [first](const vector<float>& x) {
+    return _mm_loadu_ps(x.data() + first);
+  };
+  const auto e1x = load(triangles.e1[0]);
+  const auto e1y = load(triangles.e1[1]);
+  const auto e1z = load(triangles.e1[2]);
+  const auto e2x = load(triangles.e2[0]);
+  const auto e2y = load(triangles.e2[1]);
+  const auto e2z = load(triangles.e2[2]);
+  const auto dx = _mm_set1_ps(r.direction.x);
+  const auto dy = _mm_set1_ps(r.direction.y);
+  const auto dz = _mm_set1_ps(r.direction.z);
+
+  const auto zero = _mm_setzero_ps();
+  const auto one = _mm_set1_ps(1.0f);
+
+  const auto px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+  const auto py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+  const auto pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+  const auto det = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+  const auto inv = _mm_div_ps(one, det);
+
+  const auto sx = _mm_sub_ps(_mm_set1_ps(r.origin.x), load(triangles.v0[0]));
+  const auto sy = _mm_sub_ps(_mm_set1_ps(r.origin.y), load(triangles.v0[1]));
+  const auto sz = _mm_sub_ps(_mm_set1_ps(r.origin.z), load(triangles.v0[2]));
+  const auto u = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+                 _mm_mul_ps(sz, pz)),
+      inv);
+
+  auto valid = _mm_castsi128_ps(
+      _mm_cmplt_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(count)));
+  valid = _mm_and_ps(valid, _mm_cmpneq_ps(det, zero));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(u, one));
+  if (!_mm_movemask_ps(valid)) return -1;
+
+  const auto qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  const auto qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  const auto qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+  const auto v = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                 _mm_mul_ps(dz, qz)),
+      inv);
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+  if (!_mm_movemask_ps(valid)) return -1;
+
+  const auto t = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                 _mm_mul_ps(e2z, qz)),
+      inv);
+  valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, zero));
+  valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(uvt.t)));
+  const auto mask = unsigned(_mm_movemask_ps(valid));
+  if (!mask) return -1;
+
+  alignas(16) float us[4], vs[4], ts[4];
+  _mm_store_ps(us, u);
+  _mm_store_ps(vs, v);
+  _mm_store_ps(ts, t);
+  return first + detail::closest_lane(mask, us, vs, ts, uvt);
+}
+
+inline auto intersect_sse(const ray_packet<4>& rays,
+                          const triangle& tri,
+                          intersection_packet<4>& uvt) noexcept -> unsigned {
+  const auto load = [](const float* x) { return _mm_load_ps(x); };
+  const auto edge1 = tri.vertex[1] - tri.vertex[0];
+  const auto edge2 = tri.vertex[2] - tri.vertex[0];
+  const auto e1x = _mm_set1_ps(edge1.x);
+  const auto e1y = _mm_set1_ps(edge1.y);
+  const auto e1z = _mm_set1_ps(edge1.z);
+  const auto e2x = _mm_set1_ps(edge2.x);
+  const auto e2y = _mm_set1_ps(edge2.y);
+  const auto e2z = _mm_set1_ps(edge2.z);
+  const auto dx = load(rays.direction[0]);
+  const auto dy = load(rays.direction[1]);
+  const auto dz = load(rays.direction[2]);
+
+  const auto zero = _mm_setzero_ps();
+  const auto one = _mm_set1_ps(1.0f);
+
+  const auto px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+  const auto py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+  const auto pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+  const auto det = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+  const auto inv = _mm_div_ps(one, det);
+
+  const auto sx = _mm_sub_ps(load(rays.origin[0]), _mm_set1_ps(tri.vertex[0].x));
+  const auto sy = _mm_sub_ps(load(rays.origin[1]), _mm_set1_ps(tri.vertex[0].y));
+  const auto sz = _mm_sub_ps(load(rays.origin[2]), _mm_set1_ps(tri.vertex[0].z));
+  const auto u = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+                 _mm_mul_ps(sz, pz)),
+      inv);
+
+  auto valid = _mm_cmpneq_ps(det, zero);
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(u, one));
+  if (!_mm_movemask_ps(valid)) return 0;
+
+  const auto qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  const auto qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  const auto qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+  const auto v = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                 _mm_mul_ps(dz, qz)),
+      inv);
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+  if (!_mm_movemask_ps(valid)) return 0;
+
+  const auto t = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                 _mm_mul_ps(e2z, qz)),
+      inv);
+  valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, zero));
+  valid = _mm_and_ps(valid, _mm_cmplt_ps(t, load(uvt.t)));
+
+  _mm_store_ps(uvt.u, _mm_or_ps(_mm_and_ps(valid, u),
+                                  _mm_andnot_ps(valid, load(uvt.u))));
+  _mm_store_ps(uvt.v, _mm_or_ps(_mm_and_ps(valid, v),
+                                  _mm_andnot_ps(valid, load(uvt.v))));
+  _mm_store_ps(uvt.t, _mm_or_ps(_mm_and_ps(valid, t),
+                                  _mm_andnot_ps(valid, load(uvt.t))));
+  return unsigned(_mm_movemask_ps(valid));
+}
+
+__attribute__((target("avx2"))) inline auto intersect_avx2(
+    const ray& r,
+    const triangle_soa& triangles,
+    size_t first,
+    size_t count,
+    intersection& uvt) noexcept -> size_t {
+  const auto e1x = _mm256_loadu_ps(triangles.e1[0].data() + first);
+  const auto e1y = _mm256_loadu_ps(triangles.e1[1].data() + first);
+  const auto e1z = _mm256_loadu_ps(triangles.e1[2].data() + first);
+  const auto e2x = _mm256_loadu_ps(triangles.e2[0].data() + first);
+  const auto e2y = _mm256_loadu_ps(triangles.e2[1].data() + first);
+  const auto e2z = _mm256_loadu_ps(triangles.e2[2].data() + first);
+  const auto dx = _mm256_set1_ps(r.direction.x);
+  const auto dy = _mm256_set1_ps(r.direction.y);
+  const auto dz = _mm256_set1_ps(r.direction.z);
+
+  const auto zero = _mm256_setzero_ps();
+  const auto one = _mm256_set1_ps(1.0f);
+
+  const auto px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+  const auto py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+  const auto pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+  const auto det =
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)),
+                    _mm256_mul_ps(e1z, pz));
+  const auto inv = _mm256_div_ps(one, det);
+
+  const auto sx =
+      _mm256_sub_ps(_mm256_set1_ps(r.origin.x), _mm256_loadu_ps(triangles.v0[0].data() + first));
+  const auto sy =
+      _mm256_sub_ps(_mm256_set1_ps(r.origin.y), _mm256_loadu_ps(triangles.v0[1].data() + first));
+  const auto sz =
+      _mm256_sub_ps(_mm256_set1_ps(r.origin.z), _mm256_loadu_ps(triangles.v0[2].data() + first));
+  const auto u = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)),
+                    _mm256_mul_ps(sz, pz)),
+      inv);
+
+  auto valid = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+      _mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+  if (!_mm256_movemask_ps(valid)) return -1;
+
+  const auto qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+  const auto qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+  const auto qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+  const auto v = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+                    _mm256_mul_ps(dz, qz)),
+      inv);
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+  valid = _mm256_and_ps(
+      valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+  if (!_mm256_movemask_ps(valid)) return -1;
+
+  const auto t = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+                    _mm256_mul_ps(e2z, qz)),
+      inv);
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+  valid = _mm256_and_ps(valid,
+                        _mm256_cmp_ps(t, _mm256_set1_ps(uvt.t), _CMP_LT_OQ));
+  const auto mask = unsigned(_mm256_movemask_ps(valid));
+  if (!mask) return -1;
+
+  alignas(32) float us[8], vs[8], ts[8];
+  _mm256_store_ps(us, u);
+  _mm256_store_ps(vs, v);
+  _mm256_store_ps(ts, t);
+  return first + detail::closest_lane(mask, us, vs, ts, uvt);
+}
+
+__attribute__((target("avx2"))) inline auto intersect_avx2(
+    const ray_packet<8>& rays,
+    const triangle& tri,
+    intersection_packet<8>& uvt) noexcept -> unsigned {
+  const auto edge1 = tri.vertex[1] - tri.vertex[0];
+  const auto edge2 = tri.vertex[2] - tri.vertex[0];
+  const auto e1x = _mm256_set1_ps(edge1.x);
+  const auto e1y = _mm256_set1_ps(edge1.y);
+  const auto e1z = _mm256_set1_ps(edge1.z);
+  const auto e2x = _mm256_set1_ps(edge2.x);
+  const auto e2y = _mm256_set1_ps(edge2.y);
+  const auto e2z = _mm256_set1_ps(edge2.z);
+  const auto dx = _mm256_load_ps(rays.direction[0]);
+  const auto dy = _mm256_load_ps(rays.direction[1]);
+  const auto dz = _mm256_load_ps(rays.direction[2]);
+
+  const auto zero = _mm256_setzero_ps();
+  const auto one = _mm256_set1_ps(1.0f);
+
+  const auto px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+  const auto py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+  const auto pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+  const auto det =
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)),
+                    _mm256_mul_ps(e1z, pz));
+  const auto inv = _mm256_div_ps(one, det);
+
+  const auto sx =
+      _mm256_sub_ps(_mm256_load_ps(rays.origin[0]), _mm256_set1_ps(tri.vertex[0].x));
+  const auto sy =
+      _mm256_sub_ps(_mm256_load_ps(rays.origin[1]), _mm256_set1_ps(tri.vertex[0].y));
+  const auto sz =
+      _mm256_sub_ps(_mm256_load_ps(rays.origin[2]), _mm256_set1_ps(tri.vertex[0].z));
+  const auto u = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)),
+                    _mm256_mul_ps(sz, pz)),
+      inv);
+
+  auto valid = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+  if (!_mm256_movemask_ps(valid)) return 0;
+
+  const auto qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+  const auto qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+  const auto qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+  const auto v = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+                    _mm256_mul_ps(dz, qz)),
+      inv);
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+  valid = _mm256_and_ps(
+      valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+  if (!_mm256_movemask_ps(valid)) return 0;
+
+  const auto t = _mm256_mul_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+                    _mm256_mul_ps(e2z, qz)),
+      inv);
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_load_ps(uvt.t), _CMP_LT_OQ));
+
+  _mm256_store_ps(uvt.u, _mm256_blendv_ps(_mm256_load_ps(uvt.u), u, valid));
+  _mm256_store_ps(uvt.v, _mm256_blendv_ps(_mm256_load_ps(uvt.v), v, valid));
+  _mm256_store_ps(uvt.t, _mm256_blendv_ps(_mm256_load_ps(uvt.t), t, valid));
+  return unsigned(_mm256_movemask_ps(valid));
+}
+
+#endif
+
+// Dispatch the triangles [first, first + count) in windows
+// of the kernel's lane width to the requested kernel.
+// Unavailable kernels fall back to the scalar implementation.
+inline auto intersect(const ray& r,
+                      const triangle_soa& triangles,
+                      size_t first,
+                      size_t count,
+                      intersection& uvt,
+                      intersection_kernel kernel) noexcept -> size_t {
+  size_t result = -1;
+#ifdef LIBVIEWER_X86_64_INTRINSICS
+  if (kernel == intersection_kernel::avx2 && available(kernel)) {
+    for (auto i = first; i < first + count; i += 8) {
+      const auto id =
+          intersect_avx2(r, triangles, i, std::min(count - (i - first), size_t{8}), uvt);
+      if (id != size_t(-1)) result = id;
+    }
+    return result;
+  }
+  if (kernel == intersection_kernel::sse) {
+    for (auto i = first; i < first + count; i += 4) {
+      const auto id =
+          intersect_sse(r, triangles, i, std::min(count - (i - first), size_t{4}), uvt);
+      if (id != size_t(-1)) result = id;
+    }
+    return result;
+  }
+#endif
+  return intersect_scalar(r, triangles, first, count, uvt);
+}
+
+inline auto intersect(const ray_packet<4>& rays,
+                      const triangle& t,
+                      intersection_packet<4>& uvt,
+                      intersection_kernel kernel) noexcept -> unsigned {
+#ifdef LIBVIEWER_X86_64_INTRINSICS
+  if (kernel != intersection_kernel::scalar) return intersect_sse(rays, t, uvt);
+#endif
+  return intersect_scalar(rays, t, uvt);
+}
+
+inline auto intersect(const ray_packet<8>& rays,
+                      const triangle& t,
+                      intersection_packet<8>& uvt,
+                      intersection_kernel kernel) noexcept -> unsigned {
+#ifdef LIBVIEWER_X86_64_INTRINSICS
+  if (kernel == intersection_kernel::avx2 && available(kernel))
+    return intersect_avx2(rays, t, uvt);
+#endif
+  return intersect_scalar(rays, t, uvt);
+}
+
 }  // namespace viewer
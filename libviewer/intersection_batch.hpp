@@ -0,0 +1,129 @@
+#pragma once
+#include <libviewer/scene.hpp>
+#include <libviewer/thread_pool.hpp>
+
+namespace viewer {
+
+// Spread the lower ten bits of 'x' such that two zero bits
+// follow every bit to be able to interleave three coordinates.
+constexpr auto morton_spread(uint32 x) noexcept -> uint32 {
+  x &= 0x3ff;
+  x = (x | (x << 16)) & 0x030000ff;
+  x = (x | (x << 8)) & 0x0300f00f;
+  x = (x | (x << 4)) & 0x030c30c3;
+  x = (x | (x << 2)) & 0x09249249;
+  return x;
+}
+
+// 30-bit Morton code of a point inside the unit cube.
+inline auto morton_code(const vec3& p) noexcept -> uint32 {
+  const auto q = glm::clamp(p, 0.0f, 1.0f) * 1023.0f;
+  return (morton_spread(uint32(q.x)) << 2) |
+         (morton_spread(uint32(q.y)) << 1) | morton_spread(uint32(q.z));
+}
+
+// Asynchronous intersection of many rays with a scene.
+// Rays are sorted along a Morton curve over their directions
+// and processed in chunks by the default thread pool
+// such that every thread traverses similar parts of the BVHs.
+// Within a chunk, consecutive rays are traced as packets.
+// Results are stored in the original order of the rays.
+// Every result can be awaited on its own, so callers only block
+// for the results they actually need.
+// The scene must neither be destroyed nor modified
+// as long as the batch has not been finished.
+class intersection_batch {
+ public:
+  using result_type = struct scene::intersection;
+  static constexpr size_t chunk_size = 64;
+
+  intersection_batch() = default;
+
+  intersection_batch(const struct scene& scene, vector<ray> rays)
+      : data{make_shared<state>()} {
+    auto& s = *data;
+    s.rays = move(rays);
+    s.results.resize(s.rays.size());
+
+    // Coherent ray ordering
+    vector<pair<uint32, uint32>> keys(s.rays.size());
+    for (uint32 i = 0; i < keys.size(); ++i)
+      keys[i] = {morton_code(0.5f * normalize(s.rays[i].direction) + 0.5f), i};
+    ranges::sort(keys);
+    s.order.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) s.order[i] = keys[i].second;
+
+    s.chunk.resize(s.rays.size());
+    for (size_t i = 0; i < s.order.size(); ++i)
+      s.chunk[s.order[i]] = i / chunk_size;
+
+    const auto chunks = (s.rays.size() + chunk_size - 1) / chunk_size;
+    s.done = make_unique<atomic<bool>[]>(chunks);
+
+    auto& pool = default_thread_pool();
+    const auto workers = std::min(pool.size(), chunks);
+    for (size_t i = 0; i < workers; ++i) {
+      pool.async([data = data, &scene, chunks] {
+        auto& s = *data;
+        struct ray rays[chunk_size];
+        result_type results[chunk_size];
+        for (auto c = s.next++; c < chunks; c = s.next++) {
+          const auto first = c * chunk_size;
+          const auto n = std::min(chunk_size, s.order.size() - first);
+          for (size_t i = 0; i < n; ++i) rays[i] = s.rays[s.order[first + i]];
+          scene.intersect(span{rays, n}, span{results, n});
+          for (size_t i = 0; i < n; ++i)
+            s.results[s.order[first + i]] = results[i];
+          s.done[c] = true;
+          s.done[c].notify_all();
+          ++s.finished;
+        }
+      });
+    }
+  }
+
+  auto size() const noexcept -> size_t { return data ? data->rays.size() : 0; }
+  bool empty() const noexcept { return size() == 0; }
+
+  auto ray(size_t i) const noexcept -> const struct ray& {
+    return data->rays[i];
+  }
+
+  // Check without blocking whether the i-th result has been computed.
+  bool available(size_t i) const noexcept {
+    return data->done[data->chunk[i]].load();
+  }
+
+  // Check without blocking whether all results have been computed.
+  bool available() const noexcept {
+    return !data || (data->finished.load() * chunk_size >= data->rays.size());
+  }
+
+  // Wait only for the chunk which contains the i-th result.
+  auto operator[](size_t i) const -> const result_type& {
+    data->done[data->chunk[i]].wait(false);
+    return data->results[i];
+  }
+
+  // Wait for all results.
+  auto get() const -> const vector<result_type>& {
+    for (size_t c = 0; c * chunk_size < size(); ++c) data->done[c].wait(false);
+    return data->results;
+  }
+
+ private:
+  struct state {
+    vector<struct ray> rays{};
+    vector<result_type> results{};
+    // Ray indices in processing order
+    vector<uint32> order{};
+    // Chunk index for every ray
+    vector<uint32> chunk{};
+    unique_ptr<atomic<bool>[]> done{};
+    atomic<size_t> next{0};
+    atomic<size_t> finished{0};
+  };
+  shared_ptr<state> data{};
+};
+
+}  // namespace viewer
@@ -0,0 +1,529 @@
+#pragma once
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Work done by straightening a path and its length before and after.
+// 'iterations' counts the joints that have been shortened.
+struct straightening_statistics {
+  size_t iterations{};
+  size_t flips{};
+  double initial_length{};
+  double length{};
+};
+
+// Triangulation of the same vertices and surface as an input mesh
+// whose edges are geodesic segments given by their lengths only.
+// Flipping edges keeps the geometry of the surface. The direction
+// of every half-edge at its origin is stored as an angle in the fan
+// of the input mesh. So, intrinsic edges can be traced over the input
+// faces as in Sharp, Soliman and Crane, 'Navigating Intrinsic
+// Triangulations', 2019. Half-edges '3 * f + k' start at corner 'k'
+// of face 'f' like the half-edges of meshes.
+class intrinsic_triangulation {
+ public:
+  static constexpr uint32 invalid = -1;
+  static constexpr double angle_tolerance = 1e-10;
+
+  template <typename F>
+  intrinsic_triangulation(const vector<vec3>& vertex_positions,
+                          const vector<F>& mesh_faces,
+                          const vector<uint32>& mesh_twins)
+      : positions(vertex_positions),
+        input_faces(mesh_faces.size()),
+        input_twins(mesh_twins),
+        total_angles(vertex_positions.size(), 0.0),
+        boundary(vertex_positions.size(), false) {
+    for (size_t f = 0; f < mesh_faces.size(); ++f)
+      for (int k = 0; k < 3; ++k) input_faces[f][k] = mesh_faces[f][k];
+    faces = input_faces;
+    twins = input_twins;
+    lengths.resize(twins.size());
+    for (uint32 h = 0; h < twins.size(); ++h)
+      lengths[h] = glm::distance(glm::dvec3(positions[origin(h)]),
+                                 glm::dvec3(positions[target(h)]));
+
+    // Directions accumulate the angles of the fans counterclockwise.
+    // Fans of boundary vertices start at the half-edge without twin.
+    directions.assign(twins.size(), 0.0);
+    vector<uint32> first(positions.size(), invalid);
+    for (uint32 h = 0; h < twins.size(); ++h) {
+      const auto v = origin(h);
+      if ((first[v] == invalid) || (twins[h] == invalid)) first[v] = h;
+    }
+    for (uint32 v = 0; v < positions.size(); ++v) {
+      if (first[v] == invalid) continue;
+      boundary[v] = (twins[first[v]] == invalid);
+      auto h = first[v];
+      double angle = 0.0;
+      for (size_t i = 0; i < twins.size(); ++i) {
+        directions[h] = angle;
+        angle += corner(h);
+        h = counterclockwise(h);
+        if ((h == invalid) || (h == first[v])) break;
+      }
+      total_angles[v] = angle;
+    }
+    input_directions = directions;
+    vertex_half_edges = first;
+    input_first = move(first);
+  }
+
+  static constexpr auto next(uint32 h) noexcept -> uint32 {
+    return (h % 3 == 2) ? h - 2 : h + 1;
+  }
+  static constexpr auto previous(uint32 h) noexcept -> uint32 {
+    return (h % 3 == 0) ? h + 2 : h - 1;
+  }
+  auto origin(uint32 h) const noexcept { return faces[h / 3][h % 3]; }
+  auto target(uint32 h) const noexcept { return origin(next(h)); }
+  auto twin(uint32 h) const noexcept { return twins[h]; }
+  auto length(uint32 h) const noexcept { return lengths[h]; }
+
+  // Angle opposite to the side 'a' in a triangle with the sides 'a, b, c'.
+  // The half-angle formula stays accurate for needle-like triangles.
+  static auto opposite_angle(double a, double b, double c) noexcept
+      -> double {
+    const auto x = (a - b + c) * (a + b - c);
+    const auto y = (a + b + c) * (-a + b + c);
+    if (x <= 0.0) return 0.0;
+    if (y <= 0.0) return std::numbers::pi;
+    return 2.0 * std::atan(std::sqrt(x / y));
+  }
+
+  // Interior angle of the face of 'h' at the origin of 'h'
+  auto corner(uint32 h) const noexcept -> double {
+    return opposite_angle(lengths[next(h)], lengths[h], lengths[previous(h)]);
+  }
+
+  // Next outgoing half-edge around the origin or 'invalid' at the boundary
+  auto counterclockwise(uint32 h) const noexcept -> uint32 {
+    return twins[previous(h)];
+  }
+
+  // Replace the edge of 'h' by the other diagonal of its two faces.
+  // Boundary edges and edges of quadrilaterals which are not strictly
+  // convex are kept. So, no degenerate faces are created.
+  // Half-edges of the quadrilateral may move to other indices.
+  // Afterwards, 'moved(map)' is called with a function
+  // from the old to the new indices of half-edges.
+  bool flip(uint32 h, auto&& moved) {
+    const auto t = twins[h];
+    if (t == invalid) return false;
+    const auto f = h / 3;
+    const auto g = t / 3;
+    if (f == g) return false;
+    const auto h1 = next(h);
+    const auto h2 = next(h1);
+    const auto t1 = next(t);
+    const auto t2 = next(t1);
+    const auto a = origin(h);
+    const auto b = origin(h1);
+    const auto c = origin(h2);
+    const auto d = origin(t2);
+    if ((c == d) || (a == b)) return false;
+    constexpr auto straight = std::numbers::pi - angle_tolerance;
+    if (corner(h) + corner(t1) >= straight) return false;
+    if (corner(h1) + corner(t) >= straight) return false;
+
+    // Lay out both faces in the plane with the edge on the x-axis.
+    const auto l = lengths[h];
+    const auto apex = [l](double x, double y, double sign) {
+      const auto u = (l * l + x * x - y * y) / (2 * l);
+      return glm::dvec2{u, sign * std::sqrt(std::max(x * x - u * u, 0.0))};
+    };
+    const auto pc = apex(lengths[h2], lengths[h1], 1.0);
+    const auto pd = apex(lengths[t1], lengths[t2], -1.0);
+    const auto diagonal = glm::distance(pc, pd);
+    if (!(diagonal > 0.0)) return false;
+
+    struct half_edge {
+      uint32 index, twin;
+      double length, direction;
+    };
+    const auto save = [&](uint32 x) {
+      return half_edge{x, twins[x], lengths[x], directions[x]};
+    };
+    const half_edge outer[4] = {save(t2), save(h1), save(h2), save(t1)};
+    const uint32 slots[4] = {3 * f + 1, 3 * f + 2, 3 * g + 1, 3 * g + 2};
+
+    // The new faces are 'c, d, b' and 'd, c, a'.
+    faces[f] = {c, d, b};
+    faces[g] = {d, c, a};
+    for (int i = 0; i < 4; ++i) {
+      const auto& x = outer[i];
+      const auto s = slots[i];
+      twins[s] = x.twin;
+      if (x.twin != invalid) twins[x.twin] = s;
+      lengths[s] = x.length;
+      directions[s] = x.direction;
+    }
+    twins[3 * f] = 3 * g;
+    twins[3 * g] = 3 * f;
+    lengths[3 * f] = lengths[3 * g] = diagonal;
+    // The new edge follows the outer edges counterclockwise.
+    directions[3 * f] =
+        angle_modulo(c, directions[3 * g + 1] + corner(3 * g + 1));
+    directions[3 * g] =
+        angle_modulo(d, directions[3 * f + 1] + corner(3 * f + 1));
+    vertex_half_edges[a] = 3 * g + 2;
+    vertex_half_edges[b] = 3 * f + 2;
+    vertex_half_edges[c] = 3 * f;
+    vertex_half_edges[d] = 3 * g;
+    // Moves have to be applied at once as indices are swapped.
+    moved([&](uint32 x) {
+      for (int i = 0; i < 4; ++i)
+        if (x == outer[i].index) return slots[i];
+      return x;
+    });
+    return true;
+  }
+
+  // Shorten the path through the given vertices until it is a geodesic,
+  // by the FlipOut algorithm of Sharp and Crane, 'You Can Find Geodesic
+  // Paths in Triangle Meshes by Just Flipping Edges', 2020.
+  // Consecutive vertices have to share an edge. A joint whose angle
+  // on one side is smaller than pi is shortened by flipping the edges
+  // inside of this wedge until the path can follow its outer boundary.
+  // The result is a locally shortest path whose angles are at least pi
+  // on both sides up to 'angle_tolerance'. At the boundary, only the side
+  // inside of the surface can be shortened.
+  // Returns the path traced over the input faces. If the path is empty
+  // or not connected by edges, the result is empty and 'statistics'
+  // stays unchanged such that callers can tell both cases apart.
+  auto straighten(const vector<uint32>& vertices,
+                  straightening_statistics* statistics = nullptr,
+                  size_t max_iterations = 1 << 20) -> vector<vec3> {
+    if (vertices.empty()) return {};
+    path = vertices;
+    edges.clear();
+    for (size_t i = 1; i < path.size(); ++i) {
+      const auto h = find_edge(path[i - 1], path[i]);
+      if (h == invalid) return {};
+      edges.push_back(h);
+    }
+    straightening_statistics s{};
+    s.initial_length = path_length();
+
+    // Changes only affect the neighboring joints. So, the sweep
+    // steps back by one after every shortened joint.
+    for (size_t i = 1;
+         (i + 1 < path.size()) && (s.iterations < max_iterations);) {
+      const auto in = outgoing(i, i - 1);
+      const auto out = outgoing(i, i);
+      const auto right = wedge_angle(out, in);
+      const auto left = wedge_angle(in, out);
+      if (std::min(left, right) >= std::numbers::pi - angle_tolerance) {
+        ++i;
+        continue;
+      }
+      s.flips += flip_out(i, right <= left);
+      ++s.iterations;
+      i = std::max<size_t>(i - 1, 1);
+    }
+
+    s.length = path_length();
+    if (statistics) *statistics = s;
+
+    vector<vec3> points{positions[path[0]]};
+    for (size_t i = 0; i < edges.size(); ++i) {
+      auto segment = trace(edges[i]);
+      if (origin(edges[i]) != path[i]) ranges::reverse(segment);
+      points.insert(points.end(), segment.begin() + 1, segment.end());
+    }
+    return points;
+  }
+
+  // Points where the intrinsic half-edge crosses the edges of the input
+  // faces from its origin to its target. The trace starts in direction
+  // of its signpost and is unfolded face by face. Straight lines through
+  // input vertices continue at half of their total angle.
+  auto trace(uint32 h) const -> vector<vec3> {
+    const auto end = target(h);
+    vector<vec3> points{positions[origin(h)]};
+    auto v = origin(h);
+    auto angle = directions[h];
+    auto remaining = lengths[h];
+
+    // The trace is either at the vertex 'v' or inside the face 'f'
+    // at the barycentric coordinates 'b' going in direction 'd'.
+    uint32 f = invalid;
+    vec3 b{};
+    vec3 d{};
+    for (size_t step = 0; step < 3 * input_faces.size(); ++step) {
+      if (v != invalid) {
+        const auto k = input_corner_containing(v, angle);
+        if (k == invalid) break;
+        f = k / 3;
+        const auto c = k % 3;
+        const auto offset = angle_modulo(v, angle - input_directions[k]);
+        const auto e =
+            normalize(input_position(f, (c + 1) % 3) - input_position(f, c));
+        d = float(std::cos(offset)) * e +
+            float(std::sin(offset)) * cross(input_normal(f), e);
+        b = {};
+        b[c] = 1.0f;
+        v = invalid;
+      }
+
+      // Move to the edge where the first barycentric coordinate vanishes.
+      const auto g = input_gradients(f);
+      const vec3 db{dot(g[0], d), dot(g[1], d), dot(g[2], d)};
+      float t = INFINITY;
+      int exit = -1;
+      for (int k = 0; k < 3; ++k) {
+        if ((b[k] <= 0.0f) || (db[k] >= 0.0f)) continue;
+        const auto s = -b[k] / db[k];
+        if (s >= t) continue;
+        t = s;
+        exit = k;
+      }
+      if ((exit < 0) || (t >= remaining)) break;
+      remaining -= t;
+      b = glm::max(b + t * db, vec3{0.0f});
+      b[exit] = 0.0f;
+      b /= b[0] + b[1] + b[2];
+
+      // Straight lines through vertices continue on the opposite side.
+      constexpr float vertex_tolerance = 1e-5f;
+      for (int k = 0; k < 3; ++k) {
+        if (b[k] < 1.0f - vertex_tolerance) continue;
+        v = input_faces[f][k];
+        const auto e = normalize(input_position(f, (k + 1) % 3) -
+                                 input_position(f, k));
+        const auto back = std::atan2(dot(-d, cross(input_normal(f), e)),
+                                     dot(-d, e));
+        angle = angle_modulo(v, input_directions[3 * f + k] + back +
+                                    total_angles[v] / 2);
+      }
+      if (v != invalid) {
+        if ((v == end) || boundary[v]) break;
+        points.push_back(positions[v]);
+        continue;
+      }
+      points.push_back(b[0] * input_position(f, 0) +
+                       b[1] * input_position(f, 1) +
+                       b[2] * input_position(f, 2));
+
+      // Unfold the next face around the crossed edge.
+      const auto opposite = input_twins[3 * f + (exit + 1) % 3];
+      if (opposite == invalid) break;
+      const auto x = input_faces[f][(exit + 1) % 3];
+      const auto y = input_faces[f][(exit + 2) % 3];
+      const auto bx = b[(exit + 1) % 3];
+      const auto by = b[(exit + 2) % 3];
+      f = opposite / 3;
+      int third = 0;
+      for (int k = 0; k < 3; ++k) {
+        if (input_faces[f][k] == x)
+          b[k] = bx;
+        else if (input_faces[f][k] == y)
+          b[k] = by;
+        else
+          third = k;
+      }
+      b[third] = 0.0f;
+      const auto e = normalize(positions[y] - positions[x]);
+      auto inside = cross(input_normal(f), e);
+      if (dot(inside, input_position(f, third) - positions[x]) < 0.0f)
+        inside = -inside;
+      const auto along = dot(d, e);
+      d = along * e +
+          std::sqrt(std::max(1.0f - along * along, 0.0f)) * normalize(inside);
+    }
+    points.push_back(positions[end]);
+    return points;
+  }
+
+ private:
+  auto angle_modulo(uint32 v, double angle) const noexcept -> double {
+    const auto total = total_angles[v];
+    if (total <= 0.0) return 0.0;
+    angle = std::fmod(angle, total);
+    return (angle < 0.0) ? angle + total : angle;
+  }
+
+  auto input_position(uint32 f, int k) const noexcept -> vec3 {
+    return positions[input_faces[f][k]];
+  }
+
+  auto input_normal(uint32 f) const noexcept -> vec3 {
+    const auto p = input_position(f, 0);
+    return normalize(cross(input_position(f, 1) - p, input_position(f, 2) - p));
+  }
+
+  // Computed as for the intrinsic corners. So, the angles of a fan
+  // add up to the same total.
+  auto input_corner(uint32 h) const noexcept -> double {
+    const auto f = h / 3;
+    const auto k = h % 3;
+    const auto side = [&](int i, int j) {
+      return glm::distance(glm::dvec3(input_position(f, i)),
+                           glm::dvec3(input_position(f, j)));
+    };
+    return opposite_angle(side((k + 1) % 3, (k + 2) % 3),
+                          side(k, (k + 1) % 3), side((k + 2) % 3, k));
+  }
+
+  // Outgoing input half-edge at 'v' whose corner contains the direction.
+  // Rounding may put directions slightly outside of all corners.
+  // Then the closest corner is taken.
+  auto input_corner_containing(uint32 v, double angle) const noexcept
+      -> uint32 {
+    auto best = invalid;
+    auto best_gap = double(INFINITY);
+    auto k = input_first[v];
+    for (size_t i = 0; (k != invalid) && (i < input_twins.size()); ++i) {
+      const auto offset = angle_modulo(v, angle - input_directions[k]);
+      const auto corner = input_corner(k);
+      if (offset <= corner) return k;
+      const auto gap = std::min(offset - corner, total_angles[v] - offset);
+      if (gap < best_gap) {
+        best_gap = gap;
+        best = k;
+      }
+      k = input_twins[previous(k)];
+      if (k == input_first[v]) break;
+    }
+    return best;
+  }
+
+  // Gradients of the barycentric coordinates of an input face
+  auto input_gradients(uint32 f) const noexcept -> array<vec3, 3> {
+    const vec3 e[3] = {input_position(f, 2) - input_position(f, 1),
+                       input_position(f, 0) - input_position(f, 2),
+                       input_position(f, 1) - input_position(f, 0)};
+    const auto m = cross(e[2], -e[1]);
+    const auto twice_area = glm::length(m);
+    const auto n = m / twice_area;
+    return {cross(n, e[0]) / twice_area, cross(n, e[1]) / twice_area,
+            cross(n, e[2]) / twice_area};
+  }
+
+  // Any half-edge between 'u' and 'v' found by walking around 'u'
+  auto find_edge(uint32 u, uint32 v) const noexcept -> uint32 {
+    const auto start = vertex_half_edges[u];
+    if (start == invalid) return invalid;
+    const auto match = [&](uint32 h) {
+      if (target(h) == v) return h;
+      if (origin(previous(h)) == v) return previous(h);
+      return invalid;
+    };
+    auto h = start;
+    for (size_t i = 0; i < twins.size(); ++i) {
+      if (const auto e = match(h); e != invalid) return e;
+      h = counterclockwise(h);
+      if (h == start) return invalid;
+      if (h == invalid) break;
+    }
+    // Fans of boundary vertices are also walked clockwise.
+    h = start;
+    for (size_t i = 0; (twins[h] != invalid) && (i < twins.size()); ++i) {
+      h = next(twins[h]);
+      if (const auto e = match(h); e != invalid) return e;
+    }
+    return invalid;
+  }
+
+  // Half-edge from the joint 'i' along the path edge 'e'.
+  // A boundary edge pointing towards the joint is the end of its fan
+  // and given by 'invalid'.
+  auto outgoing(size_t i, size_t e) const noexcept -> uint32 {
+    return (origin(edges[e]) == path[i]) ? edges[e] : twins[edges[e]];
+  }
+
+  // Angle swept counterclockwise from 'first' to 'last'
+  // which is infinite if the wedge would cross the boundary
+  auto wedge_angle(uint32 first, uint32 last) const noexcept -> double {
+    if (first == invalid) return INFINITY;
+    double angle = 0.0;
+    for (auto h = first; h != last; h = counterclockwise(h)) {
+      if (h == invalid) return INFINITY;
+      angle += corner(h);
+    }
+    return angle;
+  }
+
+  bool on_path(uint32 h) const noexcept {
+    const auto t = twins[h];
+    return ranges::any_of(edges,
+                          [&](uint32 e) { return (e == h) || (e == t); });
+  }
+
+  // Shorten the joint 'i' on the side counterclockwise from its
+  // outgoing to its incoming edge or on the other side if not 'right'.
+  // Returns the number of flips.
+  auto flip_out(size_t i, bool right) -> size_t {
+    const auto moved = [this](auto&& map) {
+      for (auto& e : edges) e = map(e);
+    };
+    const auto first = [&] {
+      return right ? outgoing(i, i) : outgoing(i, i - 1);
+    };
+    const auto last = [&] {
+      return right ? outgoing(i, i - 1) : outgoing(i, i);
+    };
+
+    // Edges inside the wedge are flipped while the outer boundary
+    // bends towards the joint. Every flip removes an edge of the wedge.
+    size_t flips = 0;
+    for (bool flipped = true; flipped;) {
+      flipped = false;
+      const auto end = last();
+      for (auto h = counterclockwise(first()); h != end;
+           h = counterclockwise(h)) {
+        if (on_path(h)) continue;
+        if (corner(next(h)) + corner(twins[h]) >=
+            std::numbers::pi - angle_tolerance)
+          continue;
+        if (!flip(h, moved)) continue;
+        ++flips;
+        flipped = true;
+        break;
+      }
+    }
+
+    // The outer boundary of the wedge replaces the joint.
+    vector<uint32> joints{};
+    vector<uint32> outer{};
+    const auto end = last();
+    for (auto h = first(); h != end; h = counterclockwise(h)) {
+      if (h != first()) joints.push_back(target(h));
+      outer.push_back(next(h));
+    }
+    if (right) {
+      ranges::reverse(joints);
+      ranges::reverse(outer);
+    }
+    path.erase(path.begin() + i);
+    path.insert(path.begin() + i, joints.begin(), joints.end());
+    edges.erase(edges.begin() + i - 1, edges.begin() + i + 1);
+    edges.insert(edges.begin() + i - 1, outer.begin(), outer.end());
+    return flips;
+  }
+
+  auto path_length() const noexcept -> double {
+    double result = 0.0;
+    for (auto e : edges) result += lengths[e];
+    return result;
+  }
+
+  vector<vec3> positions{};
+  vector<array<uint32, 3>> input_faces{};
+  vector<uint32> input_twins{};
+  vector<double> input_directions{};
+  vector<uint32> input_first{};
+  vector<double> total_angles{};
+  vector<bool> boundary{};
+
+  vector<array<uint32, 3>> faces{};
+  vector<uint32> twins{};
+  vector<double> lengths{};
+  vector<double> directions{};
+  vector<uint32> vertex_half_edges{};
+
+  vector<uint32> path{};
+  vector<uint32> edges{};
+};
+
+}  // namespace viewer
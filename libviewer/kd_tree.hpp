@@ -0,0 +1,240 @@
+#pragma once
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Static k-d tree over a point cloud for exact nearest-neighbor,
+// k-nearest-neighbor and radius queries.
+// Ranges of points are split at the median along their axis of largest extent
+// until they fit into a leaf. Nodes are stored in depth-first order,
+// so the left child of an inner node directly follows its parent.
+// Nodes only carry their splits and are small enough to stay in the cache,
+// whereas the points of every leaf lie contiguously in memory.
+// An inner node bounds its left points from above and its right points
+// from below by two planes. Both are the median after a build.
+// Moved points are refitted by adjusting the planes instead of rebuilding.
+class kd_tree {
+ public:
+  static constexpr size_t leaf_size = 16;
+
+  struct node {
+    bool leaf() const noexcept { return count != 0; }
+
+    // Upper bound of the left and lower bound of the right points
+    float split[2]{};
+    // Index of the right child for inner nodes
+    // and index of the first point for leaves.
+    uint32 offset{};
+    // Number of points. Inner nodes have a count of zero.
+    uint16 count{};
+    uint8 axis{};
+  };
+
+  bool empty() const noexcept { return points.empty(); }
+  auto size() const noexcept { return points.size(); }
+
+  void clear() noexcept {
+    nodes.clear();
+    points.clear();
+    indices.clear();
+  }
+
+  void build(const vector<vec3>& positions) {
+    clear();
+    if (positions.empty()) return;
+
+    indices.resize(positions.size());
+    for (uint32 i = 0; i < indices.size(); ++i) indices[i] = i;
+    nodes.reserve(4 * positions.size() / leaf_size + 1);
+    build(positions, 0, indices.size());
+
+    points.resize(positions.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+      points[i] = positions[indices[i]];
+  }
+
+  // Update the points with an original index in [first, last)
+  // to 'position(index)' and refit the planes of all nodes.
+  // The structure stays the same. So, queries stay exact
+  // but get slower if points move far from their original positions.
+  void refit(size_t first, size_t last, auto&& position) {
+    if (empty()) return;
+    for (size_t i = 0; i < indices.size(); ++i)
+      if ((first <= indices[i]) && (indices[i] < last))
+        points[i] = position(indices[i]);
+    refit(0);
+  }
+
+  // Rename points such that the point 'i' becomes 'map[i]'.
+  void remap(const auto& map) {
+    for (auto& i : indices) i = map[i];
+  }
+
+  // Index of the point nearest to 'p' or -1 if the tree is empty.
+  auto nearest(const vec3& p) const noexcept -> uint32 {
+    if (empty()) return -1;
+    size_t best = 0;
+    float best_distance = INFINITY;
+    nearest(p, 0, best, best_distance);
+    return indices[best];
+  }
+
+  // Indices of the 'k' nearest points sorted by their distance to 'p'.
+  auto nearest(const vec3& p, size_t k) const -> vector<uint32> {
+    vector<pair<float, uint32>> heap{};
+    heap.reserve(k + 1);
+    if (k && !empty()) nearest(p, k, 0, heap);
+    ranges::sort_heap(heap);
+    vector<uint32> result(heap.size());
+    for (size_t i = 0; i < heap.size(); ++i)
+      result[i] = indices[heap[i].second];
+    return result;
+  }
+
+  // Call 'f(index)' for every point whose distance to 'p'
+  // is not larger than 'radius'. Points are visited in no specific order.
+  void for_each_within(const vec3& p, float radius, auto&& f) const {
+    if (!empty()) within(p, radius * radius, 0, f);
+  }
+
+  auto within(const vec3& p, float radius) const -> vector<uint32> {
+    vector<uint32> result{};
+    for_each_within(p, radius, [&](uint32 i) { result.push_back(i); });
+    return result;
+  }
+
+ private:
+  void build(const vector<vec3>& positions, size_t first, size_t last) {
+    const auto index = nodes.size();
+    nodes.emplace_back();
+    if (last - first <= leaf_size) {
+      nodes[index].offset = first;
+      nodes[index].count = last - first;
+      return;
+    }
+
+    vec3 min{INFINITY}, max{-INFINITY};
+    for (auto i = first; i < last; ++i) {
+      min = glm::min(min, positions[indices[i]]);
+      max = glm::max(max, positions[indices[i]]);
+    }
+    const auto extent = max - min;
+    const auto axis =
+        (extent.x >= extent.y) ? ((extent.x >= extent.z) ? 0 : 2)
+                               : ((extent.y >= extent.z) ? 1 : 2);
+
+    const auto middle = first + (last - first) / 2;
+    nth_element(&indices[first], &indices[middle], &indices[0] + last,
+                [&](uint32 i, uint32 j) {
+                  return positions[i][axis] < positions[j][axis];
+                });
+    const auto split = positions[indices[middle]][axis];
+    nodes[index].split[0] = split;
+    nodes[index].split[1] = split;
+    nodes[index].axis = axis;
+
+    build(positions, first, middle);
+    nodes[index].offset = nodes.size();
+    build(positions, middle, last);
+  }
+
+  void nearest(const vec3& p,
+               size_t index,
+               size_t& best,
+               float& best_distance) const noexcept {
+    const auto& n = nodes[index];
+    if (n.leaf()) {
+      for (auto i = n.offset; i < n.offset + n.count; ++i) {
+        const auto d = distance2(p, points[i]);
+        if (d >= best_distance) continue;
+        best_distance = d;
+        best = i;
+      }
+      return;
+    }
+
+    // Visit the nearer side first to shrink the search radius early.
+    const auto [left, right] = offsets(p, n);
+    const auto near = (left < right) ? index + 1 : n.offset;
+    const auto far = (left < right) ? n.offset : index + 1;
+    const auto offset = std::max(left, right);
+    nearest(p, near, best, best_distance);
+    if (offset * offset < best_distance) nearest(p, far, best, best_distance);
+  }
+
+  // 'heap' is a max-heap of the 'k' nearest candidates found so far.
+  void nearest(const vec3& p,
+               size_t k,
+               size_t index,
+               vector<pair<float, uint32>>& heap) const {
+    const auto& n = nodes[index];
+    if (n.leaf()) {
+      for (auto i = n.offset; i < n.offset + n.count; ++i) {
+        const auto d = distance2(p, points[i]);
+        if (heap.size() == k) {
+          if (d >= heap.front().first) continue;
+          ranges::pop_heap(heap);
+          heap.pop_back();
+        }
+        heap.push_back({d, uint32(i)});
+        ranges::push_heap(heap);
+      }
+      return;
+    }
+
+    const auto [left, right] = offsets(p, n);
+    const auto near = (left < right) ? index + 1 : n.offset;
+    const auto far = (left < right) ? n.offset : index + 1;
+    const auto offset = std::max(left, right);
+    nearest(p, k, near, heap);
+    if ((heap.size() < k) || (offset * offset < heap.front().first))
+      nearest(p, k, far, heap);
+  }
+
+  void within(const vec3& p, float radius2, size_t index, auto&& f) const {
+    const auto& n = nodes[index];
+    if (n.leaf()) {
+      for (auto i = n.offset; i < n.offset + n.count; ++i)
+        if (distance2(p, points[i]) <= radius2) f(indices[i]);
+      return;
+    }
+
+    const auto [left, right] = offsets(p, n);
+    if (left * left <= radius2) within(p, radius2, index + 1, f);
+    if (right * right <= radius2) within(p, radius2, n.offset, f);
+  }
+
+  // Distances of 'p' to the left and right side of an inner node
+  // along its axis. The side containing 'p' has a distance of zero.
+  static auto offsets(const vec3& p, const node& n) noexcept
+      -> pair<float, float> {
+    const auto x = p[n.axis];
+    return {std::max(x - n.split[0], 0.0f), std::max(n.split[1] - x, 0.0f)};
+  }
+
+  // Refit the planes of the subtree and return its bounds.
+  auto refit(size_t index) -> pair<vec3, vec3> {
+    auto& n = nodes[index];
+    if (n.leaf()) {
+      vec3 min{INFINITY}, max{-INFINITY};
+      for (auto i = n.offset; i < n.offset + n.count; ++i) {
+        min = glm::min(min, points[i]);
+        max = glm::max(max, points[i]);
+      }
+      return {min, max};
+    }
+    const auto [left_min, left_max] = refit(index + 1);
+    const auto [right_min, right_max] = refit(n.offset);
+    n.split[0] = left_max[n.axis];
+    n.split[1] = right_min[n.axis];
+    return {glm::min(left_min, right_min), glm::max(left_max, right_max)};
+  }
+
+  vector<node> nodes{};
+  // Points in tree order
+  vector<vec3> points{};
+  // Original index of every point in tree order
+  vector<uint32> indices{};
+};
+
+}  // namespace viewer
@@ -0,0 +1,307 @@
+#pragma once
+#include <libviewer/path_search.hpp>
+#include <libviewer/thread_pool.hpp>
+#include <libviewer/topology_cache.hpp>
+
+namespace viewer {
+
+// Landmarks for the A* search with lower bounds by the triangle inequality
+// (ALT) of Goldberg and Harrelson, 'Computing the Shortest Path:
+// A* Search Meets Graph Theory', 2005. For every landmark 'l' of
+// an undirected graph, 'd(x, y) >= |d(l, y) - d(l, x)|' holds and
+// the maximum over all landmarks is a consistent heuristic.
+// Landmarks are chosen by farthest-point sampling. So, they lie
+// on the periphery of the graph where the bounds are tight for most pairs.
+// Distances are stored per node such that a bound reads consecutive memory.
+template <unsigned_integral I>
+struct landmarks {
+  using index_type = I;
+  static constexpr index_type invalid = -1;
+
+  bool empty() const noexcept { return nodes.empty(); }
+  auto size() const noexcept { return nodes.size(); }
+  auto memory() const noexcept -> size_t {
+    return nodes.size() * sizeof(index_type) +
+           distances.size() * sizeof(float);
+  }
+
+  // Lower bound of the distance from 'x' to 'y'.
+  // It is infinite if a landmark reaches only one of both nodes.
+  // Landmarks reaching none of them give NaN which 'max' ignores.
+  auto lower_bound(index_type x, index_type y) const noexcept -> float {
+    const auto k = nodes.size();
+    const auto dx = &distances[x * k];
+    const auto dy = &distances[y * k];
+    float result = 0.0f;
+    for (size_t i = 0; i < k; ++i)
+      result = std::max(result, std::abs(dy[i] - dx[i]));
+    return result;
+  }
+
+  // Choose up to 'count' landmarks on a graph with 'n' nodes whose edges
+  // are given by 'for_each_edge' as for the path searches.
+  // Every landmark needs a full Dijkstra search which depends on
+  // the previous ones. So, only the selection of the farthest node
+  // and the transposition of the distances run in parallel.
+  // Fewer landmarks are chosen if all nodes with edges are landmarks.
+  void build(size_t n, size_t count, auto&& for_each_edge) {
+    nodes.clear();
+    distances.clear();
+    if ((n == 0) || (count == 0)) return;
+    constexpr size_t grain = 1 << 14;
+    const auto chunks = (n + grain - 1) / grain;
+
+    // Isolated nodes would be chosen first as their distances
+    // to all landmarks are infinite but they bound nothing.
+    vector<uint8> candidates(n, 0);
+    parallel_for(
+        0, n,
+        [&](size_t x) {
+          for_each_edge(index_type(x),
+                        [&](index_type, float) { candidates[x] = 1; });
+        },
+        grain);
+
+    // Candidate with the largest distance to its closest landmark.
+    // Ties are broken by the smaller index. So, the result
+    // does not depend on the number of threads.
+    vector<float> closest(n, 0.0f);
+    vector<index_type> best(chunks);
+    const auto farthest = [&]() -> index_type {
+      parallel_for(0, chunks, [&](size_t c) {
+        auto result = invalid;
+        for (auto x = c * grain; x < std::min(n, (c + 1) * grain); ++x) {
+          if (!candidates[x]) continue;
+          if ((result == invalid) || (closest[x] > closest[result]))
+            result = x;
+        }
+        best[c] = result;
+      });
+      auto result = invalid;
+      for (auto x : best) {
+        if (x == invalid) continue;
+        if ((result == invalid) || (closest[x] > closest[result])) result = x;
+      }
+      // Remaining candidates at zero distance are landmarks already.
+      if ((result != invalid) && !(closest[result] > 0.0f)) return invalid;
+      return result;
+    };
+
+    // The first landmark is the farthest node from an arbitrary candidate.
+    const auto seed = ranges::find(candidates, 1) - candidates.begin();
+    if (size_t(seed) == n) return;
+    closest = shortest_distances(n, index_type(seed), for_each_edge);
+
+    vector<vector<float>> fields{};
+    for (size_t i = 0; i < count; ++i) {
+      const auto landmark = farthest();
+      if (landmark == invalid) break;
+      auto field = shortest_distances(n, landmark, for_each_edge);
+      if (i == 0)
+        closest = field;
+      else
+        parallel_for(
+            0, n,
+            [&](size_t x) { closest[x] = std::min(closest[x], field[x]); },
+            grain);
+      nodes.push_back(landmark);
+      fields.push_back(move(field));
+    }
+
+    const auto k = nodes.size();
+    distances.resize(n * k);
+    parallel_for(
+        0, n,
+        [&](size_t x) {
+          for (size_t i = 0; i < k; ++i) distances[x * k + i] = fields[i][x];
+        },
+        grain);
+  }
+
+  vector<index_type> nodes{};
+  // 'distances[x * size() + i]' is the distance of 'x' to 'nodes[i]'.
+  vector<float> distances{};
+};
+
+// A* search with the larger of the heuristic 'h' and the landmark bound.
+// Landmarks not computed for the 'n' nodes of the graph are not used.
+// The statistics count how often landmarks gave the larger bound.
+// If this is rare, more landmarks will not reduce the expanded nodes.
+template <unsigned_integral I>
+auto alt_shortest_path(size_t n,
+                       I src,
+                       I dst,
+                       const landmarks<I>& l,
+                       auto&& for_each_edge,
+                       auto&& h,
+                       search_statistics* statistics = nullptr) -> vector<I> {
+  if (l.empty() || (l.distances.size() != n * l.size()))
+    return shortest_path(n, src, dst, for_each_edge, h, statistics);
+  size_t bounds = 0;
+  size_t landmark_bounds = 0;
+  auto path = shortest_path(
+      n, src, dst, for_each_edge,
+      [&](I x) {
+        ++bounds;
+        const auto a = h(x);
+        const auto b = l.lower_bound(x, dst);
+        if (!(b > a)) return a;
+        ++landmark_bounds;
+        return b;
+      },
+      statistics);
+  if (statistics) {
+    statistics->bounds += bounds;
+    statistics->landmark_bounds += landmark_bounds;
+  }
+  return path;
+}
+
+// Binary file of the landmarks of all meshes of a model stored next to it.
+// Every mesh gets one record of a header and its arrays.
+// Records are only used for meshes of the same content hash. Like for
+// the topology cache, files are written to a temporary file first
+// and renamed afterwards. Failures are reported by return values.
+struct landmark_file {
+  static constexpr uint64 magic = 0x6b72616d646e616c;  // "landmark"
+  static constexpr uint32 version = 1;
+  static constexpr size_t array_count = 4;
+  static constexpr auto alignment = topology_cache::alignment;
+
+  struct header {
+    uint64 magic;
+    uint32 version;
+    uint32 index_size;
+    uint64 hash;
+    uint64 vertices;
+    uint64 faces;
+    // Size in bytes of every array
+    uint64 sizes[array_count];
+  };
+
+  static auto path(const filesystem::path& model) -> filesystem::path {
+    auto result = model;
+    result += ".landmarks";
+    return result;
+  }
+
+  // Every stored array of a mesh in the order of the file.
+  static void for_each_array(auto& mesh, auto&& f) {
+    f(mesh.vertex_landmarks.nodes);
+    f(mesh.vertex_landmarks.distances);
+    f(mesh.face_landmarks.nodes);
+    f(mesh.face_landmarks.distances);
+  }
+
+  // Landmarks of a graph with 'n' nodes have to be nodes of it
+  // and come with one distance per node and landmark.
+  template <typename I>
+  static bool consistent(const landmarks<I>& l, size_t n) {
+    return (l.distances.size() == n * l.size()) &&
+           ranges::all_of(l.nodes, [n](I x) { return x < n; });
+  }
+
+  // Returns the number of meshes whose landmarks have been read.
+  // Landmarks of all other meshes stay unchanged.
+  // Files are not trusted. Records are read into temporaries
+  // and only used if their sizes and nodes are consistent.
+  static auto load(const filesystem::path& model, auto& meshes) -> size_t {
+    const mapped_file file{path(model)};
+    if (!file) return 0;
+
+    size_t loaded = 0;
+    size_t offset = 0;
+    for (auto& mesh : meshes) {
+      using index_type = typename decay_t<decltype(mesh)>::index_type;
+      if (!topology_cache::fits(offset, sizeof(header), file.size())) break;
+      header h{};
+      memcpy(&h, file.data() + offset, sizeof(header));
+      if ((h.magic != magic) || (h.version != version) ||
+          (h.index_size != sizeof(index_type)))
+        break;
+      offset = aligned(offset + sizeof(header));
+
+      struct {
+        landmarks<index_type> vertex_landmarks{};
+        landmarks<index_type> face_landmarks{};
+      } record{};
+      size_t i = 0;
+      bool valid = true;
+      for_each_array(record, [&](auto& v) {
+        using value_type = typename decay_t<decltype(v)>::value_type;
+        const auto size = h.sizes[i++];
+        if (!valid || !topology_cache::fits(offset, size, file.size()) ||
+            (size % sizeof(value_type) != 0)) {
+          valid = false;
+          return;
+        }
+        v.resize(size / sizeof(value_type));
+        memcpy(v.data(), file.data() + offset, size);
+        offset = aligned(offset + size);
+      });
+      if (!valid) break;
+
+      if ((h.vertices != mesh.vertices.size()) ||
+          (h.faces != mesh.faces.size()) ||
+          !consistent(record.vertex_landmarks, h.vertices) ||
+          !consistent(record.face_landmarks, h.faces) ||
+          (h.hash != mesh.content_hash()))
+        continue;
+      mesh.vertex_landmarks = move(record.vertex_landmarks);
+      mesh.face_landmarks = move(record.face_landmarks);
+      ++loaded;
+    }
+    return loaded;
+  }
+
+  // Returns whether the file has been written successfully.
+  static bool store(const filesystem::path& model,
+                    const auto& meshes) noexcept {
+    try {
+      const auto file_path = path(model);
+      auto temporary = file_path;
+      temporary += "." + to_string(getpid());
+      {
+        ofstream file{temporary, ios::binary};
+        const char padding[alignment]{};
+        const auto write = [&](const void* data, size_t size) {
+          file.write(static_cast<const char*>(data), size);
+          file.write(padding, aligned(size) - size);
+        };
+        for (const auto& mesh : meshes) {
+          using index_type = typename decay_t<decltype(mesh)>::index_type;
+          header h{};
+          h.magic = magic;
+          h.version = version;
+          h.index_size = sizeof(index_type);
+          h.hash = mesh.content_hash();
+          h.vertices = mesh.vertices.size();
+          h.faces = mesh.faces.size();
+          size_t i = 0;
+          for_each_array(mesh, [&](const auto& v) {
+            h.sizes[i++] = v.size() * sizeof(v[0]);
+          });
+          write(&h, sizeof(header));
+          for_each_array(mesh, [&](const auto& v) {
+            write(v.data(), v.size() * sizeof(v[0]));
+          });
+        }
+        if (!file) {
+          file.close();
+          filesystem::remove(temporary);
+          return false;
+        }
+      }
+      filesystem::rename(temporary, file_path);
+      return true;
+    } catch (...) {
+      return false;
+    }
+  }
+
+  static constexpr auto aligned(size_t offset) noexcept -> size_t {
+    return topology_cache::aligned(offset);
+  }
+};
+
+}  // namespace viewer
@@ -37,6 +37,9 @@ struct loader {
       for (size_t j = 0; j < raw_mesh->mFaces[i].mNumIndices; j++)
         mesh.faces[i][j] = raw_mesh->mFaces[i].mIndices[j];
 
+    // Fail early instead of computing a truncated topology.
+    mesh.check_index_range();
+
     // Get the materials and textures.
     if (raw_mesh->mMaterialIndex >= 0) {
       auto raw_material = raw_scene->mMaterials[raw_mesh->mMaterialIndex];
@@ -76,6 +79,28 @@ struct loader {
 
       // cout << "Mesh " << i << ":\n" << endl;
     }
+
+    if (optimize_vertex_cache) optimize(scene);
+  }
+
+  // Files store faces in arbitrary order, which is especially bad
+  // for scanned meshes. Reordering them improves the vertex cache
+  // and vertex fetch locality of rendering.
+  void optimize(scene& scene) {
+    vector<pair<vertex_cache_statistics, vertex_cache_statistics>> statistics(
+        scene.meshes.size());
+    parallel_for(0, scene.meshes.size(), [&](size_t i) {
+      auto& mesh = scene.meshes[i];
+      statistics[i].first =
+          simulate_vertex_cache(mesh.faces, mesh.vertices.size());
+      mesh.optimize_vertex_cache();
+      statistics[i].second =
+          simulate_vertex_cache(mesh.faces, mesh.vertices.size());
+    });
+    for (size_t i = 0; const auto& [before, after] : statistics)
+      cout << "Mesh " << i++ << " Vertex Cache:\n"
+           << "  ACMR = " << before.acmr << " -> " << after.acmr << '\n'
+           << "  ATVR = " << before.atvr << " -> " << after.atvr << endl;
   }
 
   void load(czstring file_path, scene& scene) {
@@ -130,6 +155,7 @@ struct loader {
   }
 
   filesystem::path directory;
+  bool optimize_vertex_cache = false;
 };
 
 }  // namespace viewer
@@ -0,0 +1,37 @@
+#pragma once
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// GLSL functions of vertex shaders to restore the attributes
+// of 'packed_vertex' by the uniforms set by 'mesh::set_uniforms'.
+// Packed vertices store positions relative to the bounding box
+// and octahedral-encoded normals as normalized integers.
+// Unpacked vertices are passed through unchanged.
+constexpr czstring packed_vertex_shader_text =
+    "uniform bool packed_vertices;"
+    "uniform vec3 position_offset;"
+    "uniform vec3 position_scale;"
+
+    "vec3 unpack_position(vec3 x){"
+    "  return packed_vertices ? position_offset + position_scale * x : x;"
+    "}"
+
+    "vec3 unpack_normal(vec3 x){"
+    "  if (!packed_vertices) return x;"
+    "  vec3 v = vec3(x.xy, 1.0 - abs(x.x) - abs(x.y));"
+    "  float t = max(-v.z, 0.0);"
+    "  v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0.0)));"
+    "  return normalize(v);"
+    "}";
+
+// GLSL itself cannot include other sources. So, shader files
+// get the functions above by the line '#include <packed_vertex>'.
+inline auto splice_packed_vertex_shader(string source) -> string {
+  constexpr string_view directive = "#include <packed_vertex>";
+  if (const auto i = source.find(directive); i != string::npos)
+    source.replace(i, directive.size(), packed_vertex_shader_text);
+  return source;
+}
+
+}  // namespace viewer
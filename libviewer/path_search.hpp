@@ -0,0 +1,272 @@
+#pragma once
+#include <libviewer/indexed_heap.hpp>
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Algorithms for shortest paths on the vertex and face graphs of meshes.
+// Dijkstra's algorithm explores a disk around the source.
+// A* directs the search towards the destination by a heuristic.
+// The bidirectional search grows two disks of half the radius.
+// A* with landmarks (ALT) tightens the heuristic by precomputed distances.
+enum class path_search { dijkstra, astar, bidirectional, landmarks };
+
+inline auto path_search_name(path_search method) noexcept -> czstring {
+  switch (method) {
+    case path_search::astar:
+      return "astar";
+    case path_search::bidirectional:
+      return "bidirectional";
+    case path_search::landmarks:
+      return "alt";
+    default:
+      return "dijkstra";
+  }
+}
+
+// Work done by path searches which may be accumulated over many searches.
+// 'expanded' counts the nodes removed from the queues.
+// Searches with landmarks count their evaluations of the heuristic
+// in 'bounds' and those in which landmarks beat the Euclidean distance
+// in 'landmark_bounds'.
+struct search_statistics {
+  size_t searches{};
+  size_t expanded{};
+  size_t bounds{};
+  size_t landmark_bounds{};
+};
+
+// Path from 'src' to 'dst' by following 'previous' backwards.
+// As for all searches, the source is excluded and the destination included.
+template <unsigned_integral I>
+auto backtrack(const vector<I>& previous, I src, I dst) -> vector<I> {
+  I count = 0;
+  for (auto i = dst; i != src; i = previous[i]) ++count;
+  vector<I> path(count);
+  for (auto i = dst; i != src; i = previous[i]) path[--count] = i;
+  return path;
+}
+
+// Reusable state of a search over nodes in [0, n).
+// Entries of previous queries are invalidated by advancing the epoch
+// instead of clearing the arrays. Stamps equal to 'epoch' mark reached
+// and stamps equal to 'epoch + 1' mark expanded nodes. Hence,
+// the cost of a query is proportional to the region it explores.
+template <unsigned_integral I>
+struct search_workspace {
+  // Start a new query. Arrays only grow and are shared by all graphs.
+  void reset(size_t n) {
+    if (stamps.size() < n) {
+      stamps.resize(n, 0);
+      distances.resize(n);
+      previous.resize(n);
+    }
+    queue.reset(n);
+    epoch += 2;
+    if (epoch < 2) {
+      ranges::fill(stamps, 0);
+      epoch = 2;
+    }
+  }
+
+  bool reached(I x) const noexcept { return stamps[x] >= epoch; }
+  bool expanded(I x) const noexcept { return stamps[x] == epoch + 1; }
+
+  auto distance(I x) const noexcept {
+    return reached(x) ? distances[x] : float(INFINITY);
+  }
+
+  void reach(I x, float d, I p) noexcept {
+    stamps[x] = epoch;
+    distances[x] = d;
+    previous[x] = p;
+  }
+
+  void expand(I x) noexcept { stamps[x] = epoch + 1; }
+
+  // Free all memory. The next query allocates it again.
+  void release() noexcept { *this = {}; }
+
+  vector<uint32> stamps{};
+  vector<float> distances{};
+  vector<I> previous{};
+  indexed_heap<I> queue{};
+  uint32 epoch = 0;
+};
+
+// Workspaces of one thread. The bidirectional search uses one per side.
+// They are registered, so their memory can be released from other threads.
+template <unsigned_integral I>
+struct thread_search_workspaces {
+  thread_search_workspaces() {
+    scoped_lock lock{registry_mutex};
+    registry.push_back(this);
+  }
+  ~thread_search_workspaces() {
+    scoped_lock lock{registry_mutex};
+    erase(registry, this);
+  }
+  thread_search_workspaces(const thread_search_workspaces&) = delete;
+  thread_search_workspaces& operator=(const thread_search_workspaces&) =
+      delete;
+
+  search_workspace<I> sides[2]{};
+
+  static inline mutex registry_mutex{};
+  static inline vector<thread_search_workspaces*> registry{};
+};
+
+// Workspaces of the calling thread. Searches on different threads
+// never share state and need no allocations after the first queries.
+template <unsigned_integral I>
+auto thread_search_workspace(size_t side = 0) -> search_workspace<I>& {
+  thread_local thread_search_workspaces<I> workspaces{};
+  return workspaces.sides[side];
+}
+
+// Workspaces only grow with the graphs they have searched.
+// Release the memory of all threads, for example, before loading
+// another model. No search may run concurrently.
+template <unsigned_integral I>
+void release_search_workspaces() {
+  using workspaces = thread_search_workspaces<I>;
+  scoped_lock lock{workspaces::registry_mutex};
+  for (auto x : workspaces::registry)
+    for (auto& w : x->sides) w.release();
+}
+
+// A* search on a graph with 'n' nodes. 'for_each_edge(x, f)' calls
+// 'f(y, weight)' for all edges from 'x' to 'y' with non-negative weights.
+// The heuristic 'h(x)' has to be consistent, for example,
+// the Euclidean distance to the destination for edge lengths as weights.
+// Hence, every node is expanded at most once. A zero heuristic
+// gives Dijkstra's algorithm. An empty path is returned
+// if the destination cannot be reached.
+template <unsigned_integral I>
+auto shortest_path(size_t n,
+                   I src,
+                   I dst,
+                   auto&& for_each_edge,
+                   auto&& h,
+                   search_statistics* statistics = nullptr) -> vector<I> {
+  auto& w = thread_search_workspace<I>();
+  w.reset(n);
+  w.reach(src, 0.0f, src);
+  w.queue.push(src, h(src));
+  size_t expanded = 0;
+
+  while (!w.queue.empty() && !w.expanded(dst)) {
+    const auto current = w.queue.pop();
+    w.expand(current);
+    ++expanded;
+
+    for_each_edge(current, [&](I neighbor, float weight) {
+      if (w.expanded(neighbor)) return;
+      const auto d = w.distances[current] + weight;
+      if (d >= w.distance(neighbor)) return;
+      w.reach(neighbor, d, current);
+      w.queue.push_or_decrease(neighbor, d + h(neighbor));
+    });
+  }
+
+  if (statistics) {
+    ++statistics->searches;
+    statistics->expanded += expanded;
+  }
+  if (!w.expanded(dst)) return {};
+  return backtrack(w.previous, src, dst);
+}
+
+// Distances from 'src' to all nodes of a graph given as above
+// by Dijkstra's algorithm. Unreachable nodes get infinite distances.
+template <unsigned_integral I>
+auto shortest_distances(size_t n, I src, auto&& for_each_edge)
+    -> vector<float> {
+  auto& w = thread_search_workspace<I>();
+  w.reset(n);
+  w.reach(src, 0.0f, src);
+  w.queue.push(src, 0.0f);
+  while (!w.queue.empty()) {
+    const auto current = w.queue.pop();
+    w.expand(current);
+    for_each_edge(current, [&](I neighbor, float weight) {
+      if (w.expanded(neighbor)) return;
+      const auto d = w.distances[current] + weight;
+      if (d >= w.distance(neighbor)) return;
+      w.reach(neighbor, d, current);
+      w.queue.push_or_decrease(neighbor, d);
+    });
+  }
+  vector<float> result(n);
+  for (size_t x = 0; x < n; ++x) result[x] = w.distance(x);
+  return result;
+}
+
+// Bidirectional Dijkstra search on an undirected graph given as above.
+// The side with the smaller queue key is expanded. The search stops
+// when the sum of both keys reaches the length of the best path found
+// over an edge between both searches.
+template <unsigned_integral I>
+auto bidirectional_shortest_path(size_t n,
+                                 I src,
+                                 I dst,
+                                 auto&& for_each_edge,
+                                 search_statistics* statistics = nullptr)
+    -> vector<I> {
+  constexpr I invalid = -1;
+  if (statistics) ++statistics->searches;
+  if (src == dst) return {};
+
+  search_workspace<I>* w[2] = {&thread_search_workspace<I>(0),
+                               &thread_search_workspace<I>(1)};
+  const I roots[2] = {src, dst};
+  for (int s = 0; s < 2; ++s) {
+    w[s]->reset(n);
+    w[s]->reach(roots[s], 0.0f, roots[s]);
+    w[s]->queue.push(roots[s], 0.0f);
+  }
+  auto& forward = w[0]->queue;
+  auto& backward = w[1]->queue;
+
+  // The best path found so far runs from 'src' to 'meeting[0]'
+  // in the forward search and from 'meeting[1]' to 'dst'
+  // in the backward search.
+  float best = INFINITY;
+  I meeting[2] = {invalid, invalid};
+  size_t expanded = 0;
+
+  while (!forward.empty() && !backward.empty()) {
+    if (forward.top_key() + backward.top_key() >= best) break;
+    const int s = (forward.top_key() <= backward.top_key()) ? 0 : 1;
+    auto& self = *w[s];
+    const auto& other = *w[1 - s];
+    const auto current = self.queue.pop();
+    self.expand(current);
+    ++expanded;
+
+    for_each_edge(current, [&](I neighbor, float weight) {
+      const auto d = self.distances[current] + weight;
+      if (!self.expanded(neighbor) && (d < self.distance(neighbor))) {
+        self.reach(neighbor, d, current);
+        self.queue.push_or_decrease(neighbor, d);
+      }
+      const auto length = d + other.distance(neighbor);
+      if (length >= best) return;
+      best = length;
+      meeting[s] = current;
+      meeting[1 - s] = neighbor;
+    });
+  }
+
+  if (statistics) statistics->expanded += expanded;
+  if (best == INFINITY) return {};
+  auto path = backtrack(w[0]->previous, src, meeting[0]);
+  path.push_back(meeting[1]);
+  for (auto i = meeting[1]; i != dst;) {
+    i = w[1]->previous[i];
+    path.push_back(i);
+  }
+  return path;
+}
+
+}  // namespace viewer
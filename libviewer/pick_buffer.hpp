@@ -0,0 +1,186 @@
+#pragma once
+#include <libviewer/scene.hpp>
+#include <libviewer/thread_pool.hpp>
+
+namespace viewer {
+
+// Ray through the given screen position in pixels
+// with the origin in the upper-left corner.
+inline auto primary_ray(const camera& cam, float x, float y) noexcept -> ray {
+  const auto direction = normalize(
+      cam.direction() +
+      cam.pixel_size() * ((x - 0.5f * cam.screen_width()) * cam.right() +
+                          (0.5f * cam.screen_height() - y) * cam.up()));
+  return {cam.position(), direction};
+}
+
+// Screen-sized buffer of the visible mesh and face for every pixel.
+// It is rasterized completely on the CPU and therefore
+// neither needs a GPU nor a read back of OpenGL buffers.
+// After rasterization, picking a pixel is a simple lookup.
+class pick_buffer {
+ public:
+  struct texel {
+    operator bool() const noexcept { return mesh_id != uint32(-1); }
+
+    uint32 mesh_id = -1;
+    uint32 face_id = -1;
+    // Barycentric coordinates of the pixel center.
+    float u{};
+    float v{};
+  };
+
+  auto width() const noexcept { return w; }
+  auto height() const noexcept { return h; }
+
+  auto operator()(int x, int y) const noexcept -> texel {
+    if ((x < 0) || (x >= w) || (y < 0) || (y >= h)) return {};
+    return texels[size_t(y) * w + x];
+  }
+
+  bool empty() const noexcept { return texels.empty(); }
+
+  void clear() noexcept {
+    w = h = 0;
+    texels.clear();
+  }
+
+  // Screen coordinates are given in pixels with the origin
+  // in the upper-left corner like for 'primary_ray'.
+  void rasterize(const struct scene& scene, const camera& cam) {
+    w = cam.screen_width();
+    h = cam.screen_height();
+
+    // Every face gets a global index to fit into the lower half of a key.
+    face_offsets.resize(scene.meshes.size() + 1);
+    face_offsets[0] = 0;
+    for (size_t i = 0; i < scene.meshes.size(); ++i)
+      face_offsets[i + 1] = face_offsets[i] + scene.meshes[i].faces.size();
+
+    // A key stores the depth of the fragment in its upper and
+    // the global face index in its lower 32 bits.
+    // For positive depths, the bit patterns of floats keep their order.
+    // So, the visible fragment is given by the minimal key.
+    keys.assign(size_t(w) * h, uint64(-1));
+
+    const auto transform =
+        cam.projection_matrix() * cam.view_matrix() * scene.model_matrix;
+    const auto near = cam.near();
+
+    parallel_for(
+        0, face_offsets.back(),
+        [&](size_t index) {
+          const auto mesh_id = mesh_of(index);
+          const auto& m = scene.meshes[mesh_id];
+          const auto& f = m.faces[index - face_offsets[mesh_id]];
+          vec4 clip[3];
+          for (int k = 0; k < 3; ++k)
+            clip[k] = transform * vec4(m.vertices[f[k]].position, 1.0f);
+          rasterize(clip, near, uint32(index));
+        },
+        1024);
+
+    // Resolve the keys and compute perspective-correct barycentric
+    // coordinates by intersecting the pixel-center ray with the face plane.
+    // Pixels at silhouettes may slightly lie outside of their face.
+    const auto inverse_model_matrix = inverse(scene.model_matrix);
+    texels.assign(size_t(w) * h, texel{});
+    parallel_for(
+        0, size_t(h),
+        [&](size_t y) {
+          for (int x = 0; x < w; ++x) {
+            const auto key = keys[y * w + x];
+            if (key == uint64(-1)) continue;
+            const auto index = uint32(key);
+            const auto mesh_id = mesh_of(index);
+            const auto face_id = index - face_offsets[mesh_id];
+            const auto r = primary_ray(cam, x + 0.5f, y + 0.5f);
+            const ray local{
+                vec3(inverse_model_matrix * vec4(r.origin, 1.0f)),
+                vec3(inverse_model_matrix * vec4(r.direction, 0.0f))};
+            viewer::intersection uvt{};
+            intersect_plane(local, scene.meshes[mesh_id].face_triangle(face_id), uvt);
+            texels[y * w + x] = {uint32(mesh_id), uint32(face_id), uvt.u,
+                                 uvt.v};
+          }
+        },
+        8);
+  }
+
+ private:
+  auto mesh_of(size_t index) const noexcept -> size_t {
+    return ranges::upper_bound(face_offsets, index) - face_offsets.begin() - 1;
+  }
+
+  // Clip the triangle against the near plane and rasterize the result.
+  void rasterize(const vec4 (&clip)[3], float near, uint32 index) noexcept {
+    vec4 polygon[4];
+    int n = 0;
+    for (int k = 0; k < 3; ++k) {
+      const auto& a = clip[k];
+      const auto& b = clip[(k + 1) % 3];
+      const auto a_inside = a.w >= near;
+      const auto b_inside = b.w >= near;
+      if (a_inside) polygon[n++] = a;
+      if (a_inside != b_inside)
+        polygon[n++] = a + (near - a.w) / (b.w - a.w) * (b - a);
+    }
+    if (n < 3) return;
+
+    vec3 screen[4];
+    for (int k = 0; k < n; ++k) {
+      const auto inverse_w = 1.0f / polygon[k].w;
+      screen[k] = {(0.5f + 0.5f * polygon[k].x * inverse_w) * w,
+                   (0.5f - 0.5f * polygon[k].y * inverse_w) * h, inverse_w};
+    }
+    rasterize(screen[0], screen[1], screen[2], index);
+    if (n == 4) rasterize(screen[0], screen[2], screen[3], index);
+  }
+
+  // Vertices are given by their screen position and inverse depth.
+  void rasterize(const vec3& a,
+                 const vec3& b,
+                 const vec3& c,
+                 uint32 index) noexcept {
+    const auto area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0.0f) return;
+    const auto inverse_area = 1.0f / area;
+
+    const auto x_min = std::max(int(std::floor(std::min({a.x, b.x, c.x}))), 0);
+    const auto x_max = std::min(int(std::ceil(std::max({a.x, b.x, c.x}))), w);
+    const auto y_min = std::max(int(std::floor(std::min({a.y, b.y, c.y}))), 0);
+    const auto y_max = std::min(int(std::ceil(std::max({a.y, b.y, c.y}))), h);
+
+    for (int y = y_min; y < y_max; ++y) {
+      for (int x = x_min; x < x_max; ++x) {
+        const auto px = x + 0.5f;
+        const auto py = y + 0.5f;
+        // Normalized edge functions are the screen-space barycentrics.
+        const auto l0 =
+            ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * inverse_area;
+        const auto l1 =
+            ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * inverse_area;
+        const auto l2 = 1.0f - l0 - l1;
+        if ((l0 < 0.0f) || (l1 < 0.0f) || (l2 < 0.0f)) continue;
+
+        // Inverse depth is linear in screen space.
+        const auto depth = 1.0f / (l0 * a.z + l1 * b.z + l2 * c.z);
+        const auto key = (uint64(bit_cast<uint32>(depth)) << 32) | index;
+
+        atomic_ref<uint64> slot{keys[size_t(y) * w + x]};
+        auto old = slot.load(memory_order_relaxed);
+        while ((key < old) &&
+               !slot.compare_exchange_weak(old, key, memory_order_relaxed)) {
+        }
+      }
+    }
+  }
+
+  int w = 0;
+  int h = 0;
+  vector<size_t> face_offsets{};
+  vector<uint64> keys{};
+  vector<texel> texels{};
+};
+
+}  // namespace viewer
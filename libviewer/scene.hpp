@@ -3,7 +3,18 @@
 //
 #include <stb_image.h>
 //
+#include <libviewer/bvh.hpp>
+#include <libviewer/culling.hpp>
+#include <libviewer/heat_method.hpp>
 #include <libviewer/intersection.hpp>
+#include <libviewer/intrinsic_triangulation.hpp>
+#include <libviewer/landmarks.hpp>
+#include <libviewer/kd_tree.hpp>
+#include <libviewer/path_search.hpp>
+#include <libviewer/simplification.hpp>
+#include <libviewer/thread_pool.hpp>
+#include <libviewer/topology_cache.hpp>
+#include <libviewer/vertex_cache.hpp>
 
 namespace viewer {
 
@@ -50,18 +61,172 @@ using vertex_data =
     named_tuple<static_identifier_list<"position", "normal", "uv">,
                 regular_tuple<vec3, vec3, vec2>>;
 
+// Vertices as structure of arrays. Algorithms which only read positions
+// touch contiguous memory instead of 12 bytes out of every 32 bytes.
+// Elements are proxies with the members of 'vertex'.
+// So, code written for 'vector<vertex>' works for both layouts.
+class vertex_soa {
+ public:
+  using value_type = vertex;
+
+  template <bool constant>
+  struct basic_reference {
+    template <typename T>
+    using member = conditional_t<constant, const T&, T&>;
+
+    operator vertex() const noexcept { return {position, normal, uv}; }
+
+    auto operator=(const vertex& v) const noexcept
+        -> const basic_reference& requires(!constant) {
+      position = v.position;
+      normal = v.normal;
+      uv = v.uv;
+      return *this;
+    }
+
+    auto operator=(const basic_reference& x) const noexcept
+        -> const basic_reference& requires(!constant) {
+      return *this = vertex(x);
+    }
+
+    member<vec3> position;
+    member<vec3> normal;
+    member<vec2> uv;
+  };
+  using reference = basic_reference<false>;
+  using const_reference = basic_reference<true>;
+
+  // Dereferencing returns proxies by value. So, the iterators are
+  // forward iterators for ranges but only input iterators for legacy code.
+  template <bool constant>
+  struct basic_iterator {
+    using container = conditional_t<constant, const vertex_soa, vertex_soa>;
+    using value_type = vertex;
+    using difference_type = ptrdiff_t;
+    using iterator_concept = forward_iterator_tag;
+    using iterator_category = input_iterator_tag;
+
+    auto operator*() const noexcept { return (*data)[index]; }
+    auto operator++() noexcept -> basic_iterator& {
+      ++index;
+      return *this;
+    }
+    auto operator++(int) noexcept -> basic_iterator {
+      auto result = *this;
+      ++index;
+      return result;
+    }
+    bool operator==(const basic_iterator&) const noexcept = default;
+    container* data{};
+    size_t index{};
+  };
+
+  vertex_soa() = default;
+  explicit vertex_soa(const vector<vertex>& x) {
+    reserve(x.size());
+    for (const auto& v : x) push_back(v);
+  }
+
+  auto size() const noexcept { return positions.size(); }
+  bool empty() const noexcept { return positions.empty(); }
+
+  void resize(size_t n) {
+    positions.resize(n);
+    normals.resize(n);
+    uvs.resize(n);
+  }
+
+  void reserve(size_t n) {
+    positions.reserve(n);
+    normals.reserve(n);
+    uvs.reserve(n);
+  }
+
+  void clear() noexcept {
+    positions.clear();
+    normals.clear();
+    uvs.clear();
+  }
+
+  void push_back(const vertex& v) {
+    positions.push_back(v.position);
+    normals.push_back(v.normal);
+    uvs.push_back(v.uv);
+  }
+
+  auto operator[](size_t i) noexcept -> reference {
+    return {positions[i], normals[i], uvs[i]};
+  }
+  auto operator[](size_t i) const noexcept -> const_reference {
+    return {positions[i], normals[i], uvs[i]};
+  }
+
+  auto begin() noexcept { return basic_iterator<false>{this, 0}; }
+  auto end() noexcept { return basic_iterator<false>{this, size()}; }
+  auto begin() const noexcept { return basic_iterator<true>{this, 0}; }
+  auto end() const noexcept { return basic_iterator<true>{this, size()}; }
+
+  vector<vec3> positions{};
+  vector<vec3> normals{};
+  vector<vec2> uvs{};
+};
+static_assert(ranges::forward_range<vertex_soa>);
+static_assert(ranges::forward_range<const vertex_soa>);
+
+// Compact GPU layout of 'vertex' with half of its size.
+// Positions are quantized to 16 bits relative to the bounding box
+// of the mesh, normals are octahedrally encoded into two 16-bit
+// signed integers and texture coordinates are stored as half floats.
+// Shaders restore positions and normals by the uniforms set by 'mesh'.
+struct packed_vertex {
+  normalized<u16vec4> position{};
+  normalized<i16vec2> normal{};
+  half2 uv{};
+};
+static_assert(sizeof(packed_vertex) == 16);
+
+using packed_vertex_data =
+    named_tuple<static_identifier_list<"position", "normal", "uv">,
+                regular_tuple<normalized<u16vec4>, normalized<i16vec2>, half2>>;
+
+// Map a unit vector onto the octahedron and unfold it into [-1, 1]^2.
+inline auto octahedral_encode(vec3 n) noexcept -> vec2 {
+  n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (n.z >= 0.0f) return {n.x, n.y};
+  return {(1.0f - std::abs(n.y)) * ((n.x >= 0.0f) ? 1.0f : -1.0f),
+          (1.0f - std::abs(n.x)) * ((n.y >= 0.0f) ? 1.0f : -1.0f)};
+}
+
+inline auto octahedral_decode(vec2 e) noexcept -> vec3 {
+  vec3 n{e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y)};
+  const auto t = std::max(-n.z, 0.0f);
+  n.x += (n.x >= 0.0f) ? -t : t;
+  n.y += (n.y >= 0.0f) ? -t : t;
+  return normalize(n);
+}
+
 struct face : array<uint32_t, 3> {};
 // using face = array<uint32_t, 3>;
 
-struct basic_mesh {
+// Adjacency arrays and path results store indices of type 'index_type'.
+// 32-bit indices halve the memory of the topology compared to 'size_t'
+// and suffice for all meshes whose half-edges can be counted by them.
+// 'check_index_range' has to succeed before the topology is computed.
+// Vertices are stored by 'V' which is either 'vector<vertex>' or 'vertex_soa'.
+template <unsigned_integral T = uint32, typename V = vector<vertex>>
+struct basic_indexed_mesh {
+  using index_type = T;
+  using vertex_storage = V;
+  static constexpr index_type invalid_index = -1;
+
   struct edge_info {
     edge_info() {
-      face_id[0] = size_t(-1);
-      face_id[1] = size_t(-1);
+      face_id[0] = invalid_index;
+      face_id[1] = invalid_index;
     }
 
-    void add_face(size_t fid, uint32 id) {
-      if (face_id[0] == size_t(-1)) {
+    void add_face(index_type fid, uint32 id) {
+      if (face_id[0] == invalid_index) {
         face_id[0] = fid;
         location[0] = id;
         return;
@@ -71,15 +236,17 @@ struct basic_mesh {
       location[1] = id;
     }
 
-    bool inside() const noexcept { return face_id[1] != size_t(-1); }
+    bool inside() const noexcept { return face_id[1] != invalid_index; }
 
-    size_t face_id[2];
+    index_type face_id[2];
     uint32 location[2];
   };
 
-  struct dual_info {
-    size_t edge[2];
-    size_t vid[2];
+  // Edge of the dual graph to 'face' weighted by the distance
+  // of the barycenters of both faces
+  struct dual_edge {
+    index_type face;
+    float weight;
   };
 
   struct intersection : viewer::intersection {
@@ -87,16 +254,189 @@ struct basic_mesh {
     size_t face_id = -1;
   };
 
-  auto intersect(const ray& r) -> intersection {
+  // Most algorithms only read positions. Hence, they use this accessor
+  // which reads the contiguous positions of 'vertex_soa' directly.
+  auto position(size_t vid) const noexcept -> const vec3& {
+    if constexpr (same_as<V, vertex_soa>)
+      return vertices.positions[vid];
+    else
+      return vertices[vid].position;
+  }
+
+  auto face_triangle(size_t fid) const noexcept -> triangle {
+    const auto& f = faces[fid];
+    return {position(f[0]), position(f[1]), position(f[2])};
+  }
+
+  // Normal of the face scaled by twice its area
+  auto face_area_normal(size_t fid) const noexcept -> vec3 {
+    const auto t = face_triangle(fid);
+    return glm::cross(t.vertex[1] - t.vertex[0], t.vertex[2] - t.vertex[0]);
+  }
+
+  auto face_bounds(size_t fid) const noexcept -> aabb {
+    const auto& f = faces[fid];
+    return aabb{}.extend(position(f[0])).extend(position(f[1])).extend(
+        position(f[2]));
+  }
+
+  void compute_bvh() {
+    vector<aabb> bounds(faces.size());
+    for (size_t i = 0; i < faces.size(); ++i) bounds[i] = face_bounds(i);
+    face_bvh.build(bounds);
+
+    // Transposed copy of the faces in BVH order for the packet kernels.
+    face_soa.resize(faces.size());
+    for (size_t i = 0; i < faces.size(); ++i)
+      face_soa.set(i, face_triangle(face_bvh.primitives[i]));
+
+    // Incident faces of every vertex to find the faces to refit.
+    vertex_face_offset.assign(vertices.size() + 1, 0);
+    for (const auto& f : faces)
+      for (auto v : f) ++vertex_face_offset[v + 1];
+    for (size_t i = 1; i <= vertices.size(); ++i)
+      vertex_face_offset[i] += vertex_face_offset[i - 1];
+    vertex_faces.resize(vertex_face_offset.back());
+    vector<index_type> count(vertices.size(), 0);
+    for (index_type i = 0; i < faces.size(); ++i)
+      for (auto v : faces[i])
+        vertex_faces[vertex_face_offset[v] + count[v]++] = i;
+  }
+
+  // Has to be recomputed whenever vertices have been moved.
+  void compute_vertex_tree() {
+    vector<vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+      positions[i] = position(i);
+    vertex_tree.build(positions);
+  }
+
+  // Update the BVH after the positions of the vertices
+  // in the range [first, last) have changed.
+  // The topology of the mesh is assumed to be unchanged.
+  // Only boxes containing affected faces are refitted.
+  // If the SAH cost has grown beyond 'bvh_rebuild_threshold' times
+  // the cost after the last build, the BVH is rebuilt from scratch.
+  // Returns whether a rebuild has been done.
+  bool refit_bvh(size_t first, size_t last) {
+    if (face_bvh.empty() ||
+        (vertex_face_offset.size() != vertices.size() + 1)) {
+      compute_bvh();
+      return true;
+    }
+
+    vector<uint32> changed{};
+    for (auto v = first; v < last; ++v)
+      for (auto i = vertex_face_offset[v]; i < vertex_face_offset[v + 1]; ++i)
+        changed.push_back(vertex_faces[i]);
+    if (changed.empty()) return false;
+
+    // Touching most of the faces makes a sequential sweep cheaper.
+    const auto bounds = [this](uint32 fid) { return face_bounds(fid); };
+    const auto sweep = 4 * changed.size() >= faces.size();
+    if (sweep)
+      face_bvh.refit(bounds);
+    else
+      face_bvh.refit(bounds, changed);
+
+    if (face_bvh.degradation() > bvh_rebuild_threshold) {
+      compute_bvh();
+      return true;
+    }
+
+    if (sweep) {
+      for (size_t i = 0; i < faces.size(); ++i)
+        face_soa.set(i, face_triangle(face_bvh.primitives[i]));
+      return false;
+    }
+    for (auto& fid : changed) fid = face_bvh.leaves[fid];
+    ranges::sort(changed);
+    const auto [last_leaf, _] = ranges::unique(changed);
+    for (auto it = changed.begin(); it != last_leaf; ++it) {
+      const auto& leaf = face_bvh.nodes[*it];
+      for (auto i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+        face_soa.set(i, face_triangle(face_bvh.primitives[i]));
+    }
+    return false;
+  }
+
+  auto bounds() const noexcept -> aabb {
+    if (!face_bvh.empty()) return face_bvh.nodes[0].box;
+    aabb result{};
+    for (const auto& v : vertices) result.extend(v.position);
+    return result;
+  }
+
+  // Closest hit by traversing the face BVH.
+  // Only hits nearer than 't_max' are reported.
+  // Falls back to testing every face if no BVH has been built.
+  // Leaves are tested by the active intersection kernel.
+  auto intersect(const ray& r, float t_max = INFINITY) const -> intersection {
+    return intersect(r, active_intersection_kernel.load(memory_order_relaxed),
+                     t_max);
+  }
+
+  auto intersect(const ray& r,
+                 intersection_kernel kernel,
+                 float t_max = INFINITY) const -> intersection {
+    if (face_bvh.empty()) return intersect_brute_force(r, t_max);
+
+    intersection result{};
+    result.t = t_max;
+    if (kernel != intersection_kernel::scalar) {
+      face_bvh.traverse_leaves(r, result.t, [&](const bvh::node& leaf, float&) {
+        const auto i = viewer::intersect(r, face_soa, leaf.offset, leaf.count,
+                                         result, kernel);
+        if (i != size_t(-1)) result.face_id = face_bvh.primitives[i];
+      });
+      return result;
+    }
+
+    face_bvh.traverse(r, result.t, [&](uint32 i, float& t_max) {
+      viewer::intersection uvt{};
+      const auto intersected = viewer::intersect(r, face_triangle(i), uvt);
+
+      if (!intersected) return;
+      if (uvt.t >= t_max) return;
+
+      result.face_id = i;
+      result.u = uvt.u;
+      result.v = uvt.v;
+      t_max = uvt.t;
+    });
+    return result;
+  }
+
+  // Closest hits of a packet of coherent rays. Every triangle of a visited
+  // leaf is tested against all rays at once. Lanes only change
+  // for hits nearer than their current 't' in 'uvt'. For these lanes,
+  // 'face_ids' is set and their bits are returned as mask.
+  template <size_t N>
+  auto intersect(const ray_packet<N>& rays,
+                 intersection_packet<N>& uvt,
+                 size_t (&face_ids)[N],
+                 intersection_kernel kernel) const -> unsigned {
+    unsigned result = 0;
+    const auto test = [&](size_t fid) {
+      auto mask = viewer::intersect(rays, face_triangle(fid), uvt, kernel);
+      result |= mask;
+      for (; mask; mask &= mask - 1) face_ids[countr_zero(mask)] = fid;
+    };
+    if (face_bvh.empty()) {
+      for (size_t i = 0; i < faces.size(); ++i) test(i);
+      return result;
+    }
+    face_bvh.traverse(rays, uvt.t, [&](uint32 i, auto&) { test(i); });
+    return result;
+  }
+
+  auto intersect_brute_force(const ray& r, float t_max = INFINITY) const
+      -> intersection {
     intersection result{};
+    result.t = t_max;
     for (size_t i = 0; i < faces.size(); ++i) {
       viewer::intersection uvt{};
-      const auto intersected =
-          viewer::intersect(r,
-                            triangle{vertices[faces[i][0]].position,
-                                     vertices[faces[i][1]].position,
-                                     vertices[faces[i][2]].position},
-                            uvt);
+      const auto intersected = viewer::intersect(r, face_triangle(i), uvt);
 
       if (!intersected) continue;
       if (uvt.t >= result.t) continue;
@@ -117,133 +457,717 @@ struct basic_mesh {
       edges[pair{min(f[1], f[2]), max(f[1], f[2])}].add_face(i, 0);
       edges[pair{min(f[2], f[0]), max(f[2], f[0])}].add_face(i, 1);
     }
+  }
+
+  // Dual graph of the face neighbors in compressed sparse rows.
+  // Barycenters and weights are computed once instead of
+  // for every relaxation of the face path searches.
+  // The edges of the face 'x' are stored in the range
+  // [dual_offset[x], dual_offset[x + 1]) in the order of its corners.
+  // The shared edge of a dual edge is given by its two vertices
+  // in the orientation of 'x'. Requires 'compute_neighbors'.
+  void compute_dual_graph() {
+    face_barycenters.resize(faces.size());
+    parallel_for(
+        0, faces.size(),
+        [&](size_t f) { face_barycenters[f] = computed_barycenter(f); },
+        1 << 14);
+
+    dual_offset.assign(faces.size() + 1, 0);
+    for (size_t f = 0; f < faces.size(); ++f)
+      for (auto y : face_neighbors[f])
+        dual_offset[f + 1] += (y != invalid_index);
+    for (size_t f = 1; f <= faces.size(); ++f)
+      dual_offset[f] += dual_offset[f - 1];
+    dual_edges.resize(dual_offset.back());
+    dual_edge_vertices.resize(dual_offset.back());
+    parallel_for(
+        0, faces.size(),
+        [&](size_t f) {
+          auto i = dual_offset[f];
+          for (int k = 0; k < 3; ++k) {
+            const auto y = face_neighbors[f][k];
+            if (y == invalid_index) continue;
+            dual_edges[i] = {y, glm::distance(face_barycenters[f],
+                                              face_barycenters[y])};
+            dual_edge_vertices[i++] = {faces[f][(k + 1) % 3],
+                                       faces[f][(k + 2) % 3]};
+          }
+        },
+        1 << 14);
+  }
+
+  // Update barycenters and weights of the dual graph after the vertices
+  // in the range [first, last) have been moved.
+  void refit_dual_graph(size_t first, size_t last) {
+    if (dual_offset.size() != faces.size() + 1) return;
+    if (vertex_face_offset.size() != vertices.size() + 1) {
+      compute_dual_graph();
+      return;
+    }
+    const auto first_face = vertex_face_offset[first];
+    const auto last_face = vertex_face_offset[last];
+    for (auto i = first_face; i < last_face; ++i)
+      face_barycenters[vertex_faces[i]] = computed_barycenter(vertex_faces[i]);
+    // Weights are stored for both directions of every dual edge.
+    for (auto i = first_face; i < last_face; ++i) {
+      const auto x = vertex_faces[i];
+      for (auto j = dual_offset[x]; j < dual_offset[x + 1]; ++j) {
+        const auto y = dual_edges[j].face;
+        const auto w =
+            glm::distance(face_barycenters[x], face_barycenters[y]);
+        dual_edges[j].weight = w;
+        if (const auto k = dual_edge_index(y, x); k != invalid_index)
+          dual_edges[k].weight = w;
+      }
+    }
+  }
 
-    // for (const auto& [e, info] : edges) {
-    //   if (!info.inside()) continue;
-    //   auto& d = dual_edges[pair{min(info.face_id[0], info.face_id[1]),
-    //                             max(info.face_id[0], info.face_id[1])}];
-    //   d.edge = {e.first, e.second};
-    //   d.vid = {};
-    // }
+  // Index of the dual edge from 'x' to 'y' or 'invalid_index'
+  // if both faces are no neighbors or the dual graph is missing.
+  auto dual_edge_index(index_type x, index_type y) const noexcept
+      -> index_type {
+    if (dual_offset.size() != faces.size() + 1) return invalid_index;
+    for (auto i = dual_offset[x]; i < dual_offset[x + 1]; ++i)
+      if (dual_edges[i].face == y) return i;
+    return invalid_index;
   }
 
-  void compute_neighbors() {
-    neighbor_offset.resize(vertices.size() + 1);
-    neighbor_offset[0] = 0;
+  // Half-edges are given implicitly by the corners of the faces.
+  // The half-edge '3 * f + k' starts at 'faces[f][k]'
+  // and ends at 'faces[f][(k + 1) % 3]'.
+  // Hence, next, previous, face and origin need no storage.
+  // Only twins and the outgoing half-edges of every vertex are stored.
+  static constexpr index_type invalid_half_edge = invalid_index;
+
+  static constexpr auto half_edge_face(index_type h) noexcept -> index_type {
+    return h / 3;
+  }
+  static constexpr auto next_half_edge(index_type h) noexcept -> index_type {
+    return (h % 3 == 2) ? h - 2 : h + 1;
+  }
+  static constexpr auto previous_half_edge(index_type h) noexcept -> index_type {
+    return (h % 3 == 0) ? h + 2 : h - 1;
+  }
+
+  auto origin(index_type h) const noexcept -> index_type { return faces[h / 3][h % 3]; }
+  auto target(index_type h) const noexcept -> index_type {
+    return origin(next_half_edge(h));
+  }
 
-    for (const auto& [e, _] : edges) {
-      ++neighbor_offset[e.first + 1];
-      ++neighbor_offset[e.second + 1];
+  // Oppositely oriented half-edge of the adjacent face.
+  // Boundary and non-manifold edges have no twin.
+  auto twin(index_type h) const noexcept -> index_type { return twins[h]; }
+
+  auto outgoing_half_edge(index_type v) const noexcept -> index_type {
+    return (outgoing_offset[v] == outgoing_offset[v + 1])
+               ? invalid_half_edge
+               : outgoing[outgoing_offset[v]];
+  }
+
+  // Half-edge from 'u' to 'v' found by a scan over the outgoing half-edges
+  // of 'u'. These are sorted by their target and their number
+  // is given by the vertex degree which is bounded for typical meshes.
+  auto find_half_edge(index_type u, index_type v) const noexcept -> index_type {
+    for (auto i = outgoing_offset[u]; i < outgoing_offset[u + 1]; ++i) {
+      const auto t = target(outgoing[i]);
+      if (t == v) return outgoing[i];
+      if (t > v) break;
     }
+    return invalid_half_edge;
+  }
+
+  bool has_edge(index_type u, index_type v) const noexcept {
+    return (find_half_edge(u, v) != invalid_half_edge) ||
+           (find_half_edge(v, u) != invalid_half_edge);
+  }
+
+  // Hash of the positions and faces which determine the topology
+  // and the boundary segments. Chunks are hashed in parallel
+  // and their hashes are combined in order.
+  auto content_hash() const -> uint64 {
+    constexpr size_t chunk_size = size_t{1} << 16;
+    const auto vertex_chunks = (vertices.size() + chunk_size - 1) / chunk_size;
+    const auto face_chunks = (faces.size() + chunk_size - 1) / chunk_size;
+    vector<uint64> hashes(vertex_chunks + face_chunks);
+    parallel_for(0, hashes.size(), [&](size_t c) {
+      content_hasher hasher{};
+      if (c < vertex_chunks) {
+        const auto last = std::min((c + 1) * chunk_size, vertices.size());
+        for (auto i = c * chunk_size; i < last; ++i) {
+          const auto& p = position(i);
+          hasher.add((uint64(bit_cast<uint32>(p.x)) << 32) |
+                     bit_cast<uint32>(p.y));
+          hasher.add(bit_cast<uint32>(p.z));
+        }
+      } else {
+        const auto first = (c - vertex_chunks) * chunk_size;
+        const auto last = std::min(first + chunk_size, faces.size());
+        for (auto i = first; i < last; ++i) {
+          hasher.add((uint64(faces[i][0]) << 32) | faces[i][1]);
+          hasher.add(faces[i][2]);
+        }
+      }
+      hashes[c] = hasher.value();
+    });
+
+    content_hasher hasher{};
+    hasher.add(vertices.size());
+    hasher.add(faces.size());
+    for (auto h : hashes) hasher.add(h);
+    return hasher.value();
+  }
 
-    for (size_t i = 2; i <= vertices.size(); ++i)
-      neighbor_offset[i] += neighbor_offset[i - 1];
+  // Half-edges, vertices and faces have to be addressable by 'index_type'.
+  // The largest value is reserved for invalid indices.
+  void check_index_range() const {
+    if ((vertices.size() >= invalid_index) ||
+        (faces.size() >= invalid_index / 3))
+      throw overflow_error("Mesh with " + to_string(vertices.size()) +
+                           " vertices and " + to_string(faces.size()) +
+                           " faces exceeds its " +
+                           to_string(8 * sizeof(index_type)) +
+                           "-bit index type.");
+  }
 
-    vector<size_t> neighbor_count(vertices.size(), 0);
-    neighbors.resize(neighbor_offset.back());
+  // Memory of all adjacency arrays in bytes.
+  // Every index takes 'index_size' bytes, so passing 'sizeof(size_t)'
+  // gives the memory of the same arrays with 64-bit indices.
+  // Weights and barycenters of the dual graph are counted as they are.
+  auto topology_memory(size_t index_size = sizeof(index_type)) const noexcept
+      -> size_t {
+    const auto count = neighbor_offset.capacity() + neighbors.capacity() +
+                       3 * face_neighbors.capacity() + twins.capacity() +
+                       outgoing_offset.capacity() + outgoing.capacity() +
+                       vertex_face_offset.capacity() +
+                       vertex_faces.capacity() + dual_offset.capacity() +
+                       2 * dual_edge_vertices.capacity();
+    return count * index_size +
+           dual_edges.capacity() * (index_size + sizeof(float)) +
+           face_barycenters.capacity() * sizeof(vec3);
+  }
 
-    for (const auto& [e, _] : edges) {
-      neighbors[neighbor_offset[e.first] + neighbor_count[e.first]++] =
-          e.second;
-      neighbors[neighbor_offset[e.second] + neighbor_count[e.second]++] =
-          e.first;
+  // Twins are found by sorting all half-edges by their undirected edge.
+  // Equal edges are then adjacent and no hash map is needed.
+  void compute_half_edges() {
+    check_index_range();
+    const auto count = 3 * faces.size();
+
+    // Keys consist of the smaller and larger vertex and the half-edge.
+    vector<array<index_type, 3>> keys(count);
+    parallel_for(
+        0, count,
+        [&](size_t h) {
+          const auto u = origin(h);
+          const auto v = target(h);
+          keys[h] = {std::min(u, v), std::max(u, v), index_type(h)};
+        },
+        1 << 14);
+    parallel_sort(keys.begin(), keys.end());
+
+    const auto same_edge = [](const auto& x, const auto& y) {
+      return (x[0] == y[0]) && (x[1] == y[1]);
+    };
+    twins.assign(count, invalid_half_edge);
+    for (size_t i = 0; i < count;) {
+      auto j = i + 1;
+      while ((j < count) && same_edge(keys[j], keys[i])) ++j;
+      // Edges with more than two faces are non-manifold and stay unpaired.
+      // So do edges of inconsistently oriented faces.
+      if ((j - i == 2) && (origin(keys[i][2]) == target(keys[i + 1][2]))) {
+        twins[keys[i][2]] = keys[i + 1][2];
+        twins[keys[i + 1][2]] = keys[i][2];
+      }
+      i = j;
     }
 
-    for (size_t i = 0; i < vertices.size(); ++i) {
-      const auto& n = vertices[i].normal;
-      const auto& p = vertices[i].position;
+    outgoing_offset.assign(vertices.size() + 1, 0);
+    for (index_type h = 0; h < count; ++h) ++outgoing_offset[origin(h) + 1];
+    for (size_t i = 1; i <= vertices.size(); ++i)
+      outgoing_offset[i] += outgoing_offset[i - 1];
+    outgoing.resize(count);
+    {
+      vector<index_type> offset(outgoing_offset.begin(), outgoing_offset.end() - 1);
+      for (index_type h = 0; h < count; ++h) outgoing[offset[origin(h)]++] = h;
+    }
+    parallel_for(
+        0, vertices.size(),
+        [&](size_t v) {
+          sort(&outgoing[0] + outgoing_offset[v],
+               &outgoing[0] + outgoing_offset[v + 1],
+               [this](index_type a, index_type b) { return target(a) < target(b); });
+        },
+        1 << 12);
+  }
 
-      for (size_t j = neighbor_offset[i] + 1; j < neighbor_offset[i + 1]; ++j) {
-        const auto vid1 = neighbors[j - 1];
-        const auto v1 = vertices[vid1].position - p;
+  // Vertices whose neighborhood is not a simple fan.
+  struct topology_diagnostics {
+    bool empty() const noexcept {
+      return boundary_vertices.empty() && non_manifold_vertices.empty() &&
+             isolated_vertices.empty();
+    }
+
+    // Vertices whose one-ring is a single open fan
+    vector<index_type> boundary_vertices{};
+    // Vertices with more than one fan, for example,
+    // at non-manifold edges or inconsistently oriented faces
+    vector<index_type> non_manifold_vertices{};
+    // Vertices without any face
+    vector<index_type> isolated_vertices{};
+  };
 
-        bool has_neighbor = false;
-        for (size_t k = j; k < neighbor_offset[i + 1]; ++k) {
-          const auto vid2 = neighbors[k];
-          const auto v2 = vertices[vid2].position - p;
+  // Sort the neighbors of every vertex counterclockwise by walking
+  // around its fan of faces. Starting from an outgoing half-edge 'h',
+  // the next one is given by 'twin(previous_half_edge(h))'.
+  // Boundary fans start at the outgoing half-edge without twin
+  // and end with the origin of the last incoming half-edge.
+  // Every half-edge is visited once, so the ordering takes linear time.
+  // Vertices which need more than one walk are non-manifold.
+  // Their neighbors are still complete but only sorted within each fan.
+  // Requires 'compute_half_edges'.
+  auto compute_neighbors() -> const topology_diagnostics& {
+    diagnostics = {};
+    neighbor_offset.assign(vertices.size() + 1, 0);
+    neighbors.clear();
+    neighbors.reserve(outgoing.size() + vertices.size());
+    vector<bool> visited(outgoing.size(), false);
+    // 'added[w] == v' marks 'w' as a neighbor of 'v' already.
+    // Duplicates appear for vertices with several fans and for edges
+    // with more than two half-edges. Marks keep every insertion O(1).
+    vector<index_type> added(vertices.size(), invalid_index);
+
+    for (index_type v = 0; v < vertices.size(); ++v) {
+      const auto first = outgoing_offset[v];
+      const auto last = outgoing_offset[v + 1];
+      const auto add = [&](index_type vid) {
+        if (added[vid] == v) return;
+        added[vid] = v;
+        neighbors.push_back(vid);
+      };
+
+      if (first == last) diagnostics.isolated_vertices.push_back(v);
+
+      size_t fans = 0;
+      bool boundary = false;
+      for (auto remaining = last - first; remaining;) {
+        // Prefer fans starting at a boundary.
+        auto start = invalid_half_edge;
+        for (auto i = first; i < last; ++i) {
+          if (visited[outgoing[i]]) continue;
+          if ((start == invalid_half_edge) ||
+              (twin(outgoing[i]) == invalid_half_edge))
+            start = outgoing[i];
+          if (twin(start) == invalid_half_edge) break;
+        }
 
-          if (edges.contains(pair(min(vid1, vid2), max(vid1, vid2))) &&
-              (dot(n, cross(v1, v2)) > 0.0f)) {
-            swap(neighbors[k], neighbors[j]);
-            has_neighbor = true;
+        ++fans;
+        auto h = start;
+        while (true) {
+          visited[h] = true;
+          --remaining;
+          add(target(h));
+          const auto p = previous_half_edge(h);
+          const auto next = twin(p);
+          if (next == invalid_half_edge) {
+            add(origin(p));
+            boundary = true;
             break;
           }
+          if ((next == start) || visited[next]) break;
+          h = next;
         }
-        if (!has_neighbor)
-          cout << i << " " << (j - neighbor_offset[i]) << " no neighbor."
-               << endl;
       }
 
-      for (size_t j = neighbor_offset[i] + 1; j < neighbor_offset[i + 1]; ++j) {
-        if (!edges.contains(pair(min(neighbors[j - 1], neighbors[j]),
-                                 max(neighbors[j - 1], neighbors[j])))) {
-          // const auto v1 = vertices[neighbors[j - 1]].position - p;
-          // const auto v2 = vertices[neighbors[j]].position - p;
-          // if (dot(n, cross(v1, v2)) > 0.0f) continue;
-          cout << "Failed to sort neighbors: " << i << ": "
-               << (j - neighbor_offset[i]) << endl;
-          break;
+      if (fans > 1)
+        diagnostics.non_manifold_vertices.push_back(v);
+      else if (boundary)
+        diagnostics.boundary_vertices.push_back(v);
+      neighbor_offset[v + 1] = neighbors.size();
+    }
+
+    // The neighbor opposite to the corner 'k' of a face
+    // shares the half-edge starting at the corner 'k + 1'.
+    face_neighbors.resize(faces.size());
+    for (index_type f = 0; f < faces.size(); ++f) {
+      for (index_type k = 0; k < 3; ++k) {
+        const auto t = twin(3 * f + (k + 1) % 3);
+        face_neighbors[f][k] =
+            (t == invalid_half_edge) ? invalid_index : half_edge_face(t);
+      }
+    }
+
+    return diagnostics;
+  }
+
+  // Spatially coherent set of faces with bounds and a normal cone.
+  // Its faces are given by 'cluster_faces[offset, offset + count)'.
+  struct cluster : bounding_cone {
+    aabb box{};
+    index_type offset{};
+    index_type count{};
+  };
+
+  // Partition the faces into clusters of at most 'max_faces' faces
+  // by greedy growth over the face neighbors. The next face of a cluster
+  // is the frontier face with the most neighbors already in the cluster
+  // and, among these, the one nearest to the seed. This keeps clusters
+  // compact and avoids thin leftovers. New clusters are seeded
+  // at faces bordering the previous ones.
+  // Requires 'compute_neighbors'.
+  void compute_clusters(size_t max_faces = 128) {
+    clusters.clear();
+    cluster_faces.clear();
+    cluster_faces.reserve(faces.size());
+    vector<bool> assigned(faces.size(), false);
+    vector<index_type> frontier{};
+    vector<index_type> seeds{};
+    size_t cursor = 0;
+
+    vector<vec3> barycenters(faces.size());
+    parallel_for(
+        0, faces.size(),
+        [&](size_t f) {
+          const auto t = face_triangle(f);
+          barycenters[f] = (t.vertex[0] + t.vertex[1] + t.vertex[2]) / 3.0f;
+        },
+        1 << 14);
+    const auto assigned_neighbors = [&](index_type f) {
+      int count = 0;
+      for (auto n : face_neighbors[f])
+        count += (n == invalid_index) || assigned[n];
+      return count;
+    };
+
+    while (true) {
+      auto seed = invalid_index;
+      while (!seeds.empty() && (seed == invalid_index)) {
+        if (!assigned[seeds.back()]) seed = seeds.back();
+        seeds.pop_back();
+      }
+      while ((seed == invalid_index) && (cursor < faces.size()))
+        if (!assigned[cursor++]) seed = cursor - 1;
+      if (seed == invalid_index) break;
+
+      cluster c{};
+      c.offset = cluster_faces.size();
+      const auto center = barycenters[seed];
+      frontier.assign(1, seed);
+      while (!frontier.empty() && (c.count < max_faces)) {
+        size_t best = 0;
+        auto best_count = -1;
+        auto best_distance = INFINITY;
+        for (size_t i = 0; i < frontier.size(); ++i) {
+          const auto count = assigned_neighbors(frontier[i]);
+          const auto d = distance2(center, barycenters[frontier[i]]);
+          if ((count < best_count) ||
+              ((count == best_count) && (d >= best_distance)))
+            continue;
+          best = i;
+          best_count = count;
+          best_distance = d;
+        }
+        const auto f = frontier[best];
+        frontier[best] = frontier.back();
+        frontier.pop_back();
+
+        assigned[f] = true;
+        cluster_faces.push_back(f);
+        ++c.count;
+        for (auto n : face_neighbors[f]) {
+          if ((n == invalid_index) || assigned[n]) continue;
+          if (ranges::find(frontier, n) == frontier.end())
+            frontier.push_back(n);
         }
       }
+      for (auto f : frontier) seeds.push_back(f);
+      clusters.push_back(c);
     }
 
-    // for (size_t i = 0; i < vertices.size(); ++i) {
-    //   assert(neighbor_count[i] == neighbor_offset[i + 1] - neighbor_offset[i]);
-    // cout << i << ": " << neighbor_offset[i + 1] - neighbor_offset[i] << ": ";
-    // for (size_t j = neighbor_offset[i]; j < neighbor_offset[i + 1]; ++j)
-    //   cout << neighbors[j] << ", ";
-    // cout << endl;
-    // }
+    parallel_for(
+        0, clusters.size(), [&](size_t i) { compute_cluster_bounds(i); },
+        1 << 8);
+  }
 
-    face_neighbors.resize(faces.size());
-    for (const auto& [e, info] : edges) {
-      assert(info.face_id[0] < faces.size());
+  void compute_cluster_bounds(size_t id) {
+    auto& c = clusters[id];
+    const auto first = cluster_faces.begin() + c.offset;
+    const auto last = first + c.count;
 
-      face_neighbors[info.face_id[0]][info.location[0]] = info.face_id[1];
-      if (!info.inside()) continue;
-      face_neighbors[info.face_id[1]][info.location[1]] = info.face_id[0];
+    c.box = {};
+    vec3 normal{};
+    for (auto it = first; it != last; ++it) {
+      c.box.extend(face_bounds(*it));
+      normal += face_area_normal(*it);
+    }
+    c.center = c.box.center();
+    c.radius = 0.0f;
+    for (auto it = first; it != last; ++it)
+      for (auto v : faces[*it])
+        c.radius = std::max(c.radius, glm::distance(c.center, position(v)));
+
+    // The area-weighted average normal is the axis. A cone wider
+    // than a half space cannot be used for culling.
+    c.axis = vec3{0, 0, 1};
+    c.cutoff = 1.0f;
+    if (length(normal) == 0.0f) return;
+    c.axis = normalize(normal);
+    auto min_dot = 1.0f;
+    for (auto it = first; it != last; ++it) {
+      const auto n = face_area_normal(*it);
+      if (length(n) == 0.0f) continue;
+      min_dot = std::min(min_dot, dot(c.axis, normalize(n)));
+    }
+    if (min_dot > 0.0f) c.cutoff = std::sqrt(1.0f - min_dot * min_dot);
+  }
 
-      assert(faces[info.face_id[0]][info.location[0]] != e.first);
-      assert(faces[info.face_id[0]][info.location[0]] != e.second);
+  // Update the bounds and normal cones of all clusters with faces
+  // incident to the vertices in the range [first, last).
+  void refit_clusters(size_t first, size_t last) {
+    if (clusters.empty()) return;
+    // Without the incident faces of the vertices, all clusters are updated.
+    const auto all = vertex_face_offset.size() != vertices.size() + 1;
+    vector<bool> moved(faces.size(), all);
+    if (!all)
+      for (auto i = vertex_face_offset[first]; i < vertex_face_offset[last];
+           ++i)
+        moved[vertex_faces[i]] = true;
+    parallel_for(
+        0, clusters.size(),
+        [&](size_t i) {
+          const auto& c = clusters[i];
+          for (auto j = c.offset; j < c.offset + c.count; ++j) {
+            if (!moved[cluster_faces[j]]) continue;
+            compute_cluster_bounds(i);
+            return;
+          }
+        },
+        1 << 8);
+  }
+
+  // Call 'f(cluster, faces)' for every cluster
+  // where 'faces' is the range of its face indices.
+  void for_each_cluster(auto&& f) const {
+    for (const auto& c : clusters)
+      f(c, span{cluster_faces}.subspan(c.offset, c.count));
+  }
+
+  // Simplified mesh given by 'lod_faces[offset, offset + count)'.
+  // Its faces refer to the original vertices.
+  struct lod_level {
+    index_type offset{};
+    index_type count{};
+    // Bound of the distance to the original surface in object space
+    float error{};
+  };
+
+  struct lod_chain {
+    vector<lod_level> levels{};
+    vector<face> faces{};
+  };
+
+  // Chain of levels of detail each with about 'ratio' times the faces
+  // of the previous one. Every level is simplified from its predecessor.
+  // So, their errors are accumulated. The chain stops below 'min_faces'
+  // or if simplification gets stuck. It only depends on its arguments
+  // and can be built from copies of the mesh in the background.
+  static auto simplify_lods(const auto& vertices,
+                            const vector<face>& faces,
+                            size_t min_faces = 1024,
+                            float ratio = 0.5f,
+                            size_t max_levels = 8) -> lod_chain {
+    lod_chain result{};
+    simplification<face> level{faces, 0.0f};
+    float error = 0.0f;
+    while (result.levels.size() < max_levels) {
+      const auto target = size_t(ratio * level.faces.size());
+      if (target < min_faces) break;
+      const auto previous = level.faces.size();
+      level = simplify(vertices, level.faces, target);
+      if (level.faces.size() > (1.0f + ratio) / 2 * previous) break;
+      error += level.error;
+      result.levels.push_back({index_type(result.faces.size()),
+                               index_type(level.faces.size()), error});
+      result.faces.insert(result.faces.end(), level.faces.begin(),
+                          level.faces.end());
+    }
+    return result;
+  }
 
-      assert(min(faces[info.face_id[0]][(info.location[0] + 1) % 3],
-                 faces[info.face_id[0]][(info.location[0] + 2) % 3]) ==
-             e.first);
-      assert(max(faces[info.face_id[0]][(info.location[0] + 1) % 3],
-                 faces[info.face_id[0]][(info.location[0] + 2) % 3]) ==
-             e.second);
+  // Picking, paths and curves keep using 'faces'
+  // as levels of detail are only meant for drawing.
+  void compute_lods(size_t min_faces = 1024,
+                    float ratio = 0.5f,
+                    size_t max_levels = 8) {
+    set_lods(simplify_lods(vertices, faces, min_faces, ratio, max_levels));
+  }
+
+  void set_lods(lod_chain&& chain) noexcept {
+    lods = move(chain.levels);
+    lod_faces = move(chain.faces);
+  }
 
-      assert(faces[info.face_id[1]][info.location[1]] != e.first);
-      assert(faces[info.face_id[1]][info.location[1]] != e.second);
+  // Coarsest level whose error does not exceed the given bound.
+  // Zero refers to the original faces and 'i + 1' to 'lods[i]'.
+  auto lod(float max_error) const noexcept -> size_t {
+    size_t level = 0;
+    while ((level < lods.size()) && (lods[level].error <= max_error)) ++level;
+    return level;
+  }
 
-      assert(min(faces[info.face_id[1]][(info.location[1] + 1) % 3],
-                 faces[info.face_id[1]][(info.location[1] + 2) % 3]) ==
-             e.first);
-      assert(max(faces[info.face_id[1]][(info.location[1] + 1) % 3],
-                 faces[info.face_id[1]][(info.location[1] + 2) % 3]) ==
-             e.second);
+  // Move the row 'i' of a compressed sparse row array to 'row_map[i]'
+  // and transform its values by 'value_map'. Values keep their order.
+  static void remap_rows(vector<index_type>& offset,
+                         vector<index_type>& values,
+                         const vector<index_type>& row_map,
+                         auto&& value_map) {
+    if (offset.empty()) return;
+    const auto rows = offset.size() - 1;
+    vector<index_type> remapped_offset(rows + 1, 0);
+    for (size_t i = 0; i < rows; ++i)
+      remapped_offset[row_map[i] + 1] = offset[i + 1] - offset[i];
+    for (size_t i = 1; i <= rows; ++i)
+      remapped_offset[i] += remapped_offset[i - 1];
+    vector<index_type> remapped(values.size());
+    for (size_t i = 0; i < rows; ++i) {
+      auto j = remapped_offset[row_map[i]];
+      for (auto k = offset[i]; k < offset[i + 1]; ++k)
+        remapped[j++] = value_map(values[k]);
     }
+    offset = move(remapped_offset);
+    values = move(remapped);
   }
 
-  auto distance(size_t x, size_t y) const noexcept -> float {
-    return glm::distance(vertices[x].position, vertices[y].position);
+  // Reorder faces for the post-transform vertex cache by 'tipsify'
+  // and renumber vertices in the order of their first use
+  // such that vertex fetches become mostly sequential.
+  // Unreferenced vertices are moved to the end.
+  void optimize_vertex_cache(size_t cache_size = 16) {
+    check_index_range();
+    const auto order = tipsify(faces, vertices.size(), cache_size);
+    vector<index_type> face_map(faces.size());
+    for (index_type i = 0; i < order.size(); ++i) face_map[order[i]] = i;
+
+    vector<index_type> vertex_map(vertices.size(), invalid_index);
+    index_type count = 0;
+    for (auto f : order)
+      for (auto v : faces[f])
+        if (vertex_map[v] == invalid_index) vertex_map[v] = count++;
+    for (auto& v : vertex_map)
+      if (v == invalid_index) v = count++;
+
+    remap(vertex_map, face_map);
   }
 
-  auto compute_shortest_path(size_t src_vid, size_t dst_vid) const
-      -> vector<size_t> {
+  // Renumber vertices and faces such that the vertex 'i' becomes
+  // 'vertex_map[i]' and the face 'i' becomes 'face_map[i]'.
+  // Corners of faces keep their order. So, the half-edge '3 * f + k'
+  // becomes '3 * face_map[f] + k'. All computed data structures
+  // are remapped, so nothing needs to be recomputed afterwards.
+  void remap(const vector<index_type>& vertex_map,
+             const vector<index_type>& face_map) {
+    const auto map_vertex = [&](index_type v) {
+      return (v == invalid_index) ? v : vertex_map[v];
+    };
+    const auto map_face = [&](index_type f) {
+      return (f == invalid_index) ? f : face_map[f];
+    };
+    const auto map_half_edge = [&](index_type h) {
+      return (h == invalid_half_edge) ? h : 3 * face_map[h / 3] + h % 3;
+    };
+
+    {
+      V remapped{};
+      remapped.resize(vertices.size());
+      for (size_t i = 0; i < vertices.size(); ++i)
+        remapped[vertex_map[i]] = vertices[i];
+      vertices = move(remapped);
+    }
+    {
+      vector<face> remapped(faces.size());
+      for (size_t i = 0; i < faces.size(); ++i)
+        for (int k = 0; k < 3; ++k)
+          remapped[face_map[i]][k] = vertex_map[faces[i][k]];
+      faces = move(remapped);
+    }
+
+    if (!twins.empty()) {
+      vector<index_type> remapped(twins.size());
+      for (size_t h = 0; h < twins.size(); ++h)
+        remapped[map_half_edge(h)] = map_half_edge(twins[h]);
+      twins = move(remapped);
+    }
+    remap_rows(outgoing_offset, outgoing, vertex_map, map_half_edge);
+    parallel_for(
+        0, outgoing_offset.size() - !outgoing_offset.empty(),
+        [&](size_t v) {
+          sort(&outgoing[0] + outgoing_offset[v],
+               &outgoing[0] + outgoing_offset[v + 1],
+               [this](index_type a, index_type b) {
+                 return target(a) < target(b);
+               });
+        },
+        1 << 12);
+
+    remap_rows(neighbor_offset, neighbors, vertex_map, map_vertex);
+    if (!face_neighbors.empty()) {
+      vector<array<index_type, 3>> remapped(face_neighbors.size());
+      for (size_t i = 0; i < face_neighbors.size(); ++i)
+        for (int k = 0; k < 3; ++k)
+          remapped[face_map[i]][k] = map_face(face_neighbors[i][k]);
+      face_neighbors = move(remapped);
+    }
+    for (auto list : {&diagnostics.boundary_vertices,
+                      &diagnostics.non_manifold_vertices,
+                      &diagnostics.isolated_vertices}) {
+      for (auto& v : *list) v = map_vertex(v);
+      ranges::sort(*list);
+    }
+
+    if (!edges.empty()) {
+      decltype(edges) remapped{};
+      for (auto [e, info] : edges) {
+        const auto a = map_vertex(e.first);
+        const auto b = map_vertex(e.second);
+        for (auto& f : info.face_id) f = map_face(f);
+        remapped.emplace(pair{std::min(a, b), std::max(a, b)}, info);
+      }
+      edges = move(remapped);
+    }
+    // Rows of the dual graph follow the remapped faces.
+    if (!dual_offset.empty()) compute_dual_graph();
+
+    // Boxes and the transposed faces of the BVH keep their geometry.
+    face_bvh.remap(face_map);
+    for (auto& f : cluster_faces) f = face_map[f];
+    for (auto& f : lod_faces)
+      for (auto& v : f) v = vertex_map[v];
+    remap_rows(vertex_face_offset, vertex_faces, vertex_map, map_face);
+    vertex_tree.remap(vertex_map);
+    // The factorizations depend on the order and have to be recomputed.
+    geodesics = {};
+    vertex_landmarks = {};
+    face_landmarks = {};
+  }
+
+  auto distance(index_type x, index_type y) const noexcept -> float {
+    return glm::distance(position(x), position(y));
+  }
+
+  auto compute_shortest_path(index_type src_vid, index_type dst_vid) const
+      -> vector<index_type> {
     vector<bool> visited(vertices.size(), false);
     vector<float> distances(vertices.size(), INFINITY);
-    vector<size_t> previous(vertices.size());
-    vector<size_t> count(vertices.size());
+    vector<index_type> previous(vertices.size());
+    vector<index_type> count(vertices.size());
     distances[src_vid] = 0;
     previous[src_vid] = src_vid;
     count[src_vid] = 0;
 
-    size_t current = src_vid;
+    index_type current = src_vid;
     float min_distance = INFINITY;
 
     do {
-      for (size_t i = neighbor_offset[current];  //
+      for (index_type i = neighbor_offset[current];  //
            i < neighbor_offset[current + 1]; ++i) {
         const auto neighbor = neighbors[i];
         if (visited[neighbor]) continue;
@@ -256,7 +1180,7 @@ struct basic_mesh {
       visited[current] = true;
 
       min_distance = INFINITY;
-      for (size_t i = 0; i < vertices.size(); ++i) {
+      for (index_type i = 0; i < vertices.size(); ++i) {
         if (visited[i]) continue;
         if (distances[i] >= min_distance) continue;
         min_distance = distances[i];
@@ -268,9 +1192,9 @@ struct basic_mesh {
     if (min_distance == INFINITY) return {};
 
     // Backtrack the path.
-    vector<size_t> path(count[dst_vid]);
+    vector<index_type> path(count[dst_vid]);
     current = dst_vid;
-    size_t index = path.size() - 1;
+    index_type index = path.size() - 1;
     do {
       path[index--] = current;
       current = previous[current];
@@ -278,132 +1202,390 @@ struct basic_mesh {
     return path;
   }
 
-  auto compute_shortest_path_fast(size_t src, size_t dst) const
-      -> vector<size_t> {
-    vector<bool> visited(vertices.size(), false);
-
-    vector<float> distances(vertices.size(), INFINITY);
-    distances[src] = 0;
+  // Vertex graph weighted by edge lengths
+  auto for_each_vertex_edge(index_type x, auto&& f) const {
+    for (auto i = neighbor_offset[x]; i < neighbor_offset[x + 1]; ++i)
+      f(neighbors[i], distance(x, neighbors[i]));
+  }
 
-    vector<size_t> previous(vertices.size());
-    previous[src] = src;
+  auto computed_barycenter(index_type fid) const noexcept -> vec3 {
+    const auto& f = faces[fid];
+    return (position(f[0]) + position(f[1]) + position(f[2])) / 3.0f;
+  }
 
-    vector<size_t> queue{src};
-    const auto order = [&](size_t i, size_t j) {
-      return distances[i] > distances[j];
-    };
+  // Barycenters are read from the dual graph if it has been computed.
+  auto face_barycenter(index_type fid) const noexcept -> vec3 {
+    if (!face_barycenters.empty()) return face_barycenters[fid];
+    return computed_barycenter(fid);
+  }
 
-    do {
-      ranges::make_heap(queue, order);
-      ranges::pop_heap(queue, order);
-      const auto current = queue.back();
-      queue.pop_back();
+  // Dual graph weighted by distances of face barycenters.
+  // Without 'compute_dual_graph', the weights are computed on the fly.
+  auto for_each_face_edge(index_type x, auto&& f) const {
+    if (!dual_offset.empty()) {
+      for (auto i = dual_offset[x]; i < dual_offset[x + 1]; ++i)
+        f(dual_edges[i].face, dual_edges[i].weight);
+      return;
+    }
+    const auto p = face_barycenter(x);
+    for (auto y : face_neighbors[x]) {
+      if (y == invalid_index) continue;
+      f(y, glm::distance(p, face_barycenter(y)));
+    }
+  }
 
-      // cout << "current = " << current << endl;
+  // Dijkstra's algorithm with an indexed heap in O((V + E) log V)
+  auto compute_shortest_path_fast(index_type src,
+                                  index_type dst,
+                                  search_statistics* statistics = nullptr) const
+      -> vector<index_type> {
+    return shortest_path(
+        vertices.size(), src, dst,
+        [this](index_type x, auto&& f) { for_each_vertex_edge(x, f); },
+        [](index_type) { return 0.0f; }, statistics);
+  }
 
-      visited[current] = true;
+  // The Euclidean distance never overestimates the length of edge paths.
+  auto compute_shortest_path_astar(index_type src,
+                                   index_type dst,
+                                   search_statistics* statistics = nullptr)
+      const -> vector<index_type> {
+    const auto target = position(dst);
+    return shortest_path(
+        vertices.size(), src, dst,
+        [this](index_type x, auto&& f) { for_each_vertex_edge(x, f); },
+        [&](index_type x) { return glm::distance(position(x), target); },
+        statistics);
+  }
 
-      for (auto i = neighbor_offset[current];  //
-           i < neighbor_offset[current + 1]; ++i) {
-        const auto neighbor = neighbors[i];
-        if (visited[neighbor]) continue;
+  // A* with the larger of the Euclidean and the landmark bound.
+  // The maximum of consistent heuristics is consistent.
+  // Without landmarks, this is the Euclidean A* search.
+  auto compute_shortest_path_landmarks(index_type src,
+                                       index_type dst,
+                                       search_statistics* statistics =
+                                           nullptr) const
+      -> vector<index_type> {
+    const auto target = position(dst);
+    return alt_shortest_path(
+        vertices.size(), src, dst, vertex_landmarks,
+        [this](index_type x, auto&& f) { for_each_vertex_edge(x, f); },
+        [&](index_type x) { return glm::distance(position(x), target); },
+        statistics);
+  }
 
-        const auto d = distance(current, neighbor) + distances[current];
-        if (d >= distances[neighbor]) continue;
+  auto compute_shortest_path_bidirectional(
+      index_type src,
+      index_type dst,
+      search_statistics* statistics = nullptr) const -> vector<index_type> {
+    return bidirectional_shortest_path(
+        vertices.size(), src, dst,
+        [this](index_type x, auto&& f) { for_each_vertex_edge(x, f); },
+        statistics);
+  }
 
-        distances[neighbor] = d;
-        previous[neighbor] = current;
-        queue.push_back(neighbor);
-      }
-    } while (!queue.empty() && !visited[dst]);
+  auto compute_shortest_face_path_fast(index_type src,
+                                       index_type dst,
+                                       search_statistics* statistics =
+                                           nullptr) const
+      -> vector<index_type> {
+    return shortest_path(
+        faces.size(), src, dst,
+        [this](index_type x, auto&& f) { for_each_face_edge(x, f); },
+        [](index_type) { return 0.0f; }, statistics);
+  }
 
-    if (queue.empty()) return {};
+  auto compute_shortest_face_path_astar(index_type src,
+                                        index_type dst,
+                                        search_statistics* statistics =
+                                            nullptr) const
+      -> vector<index_type> {
+    const auto target = face_barycenter(dst);
+    return shortest_path(
+        faces.size(), src, dst,
+        [this](index_type x, auto&& f) { for_each_face_edge(x, f); },
+        [&](index_type x) {
+          return glm::distance(face_barycenter(x), target);
+        },
+        statistics);
+  }
 
-    // cout << "dst visited" << endl;
+  auto compute_shortest_face_path_landmarks(index_type src,
+                                            index_type dst,
+                                            search_statistics* statistics =
+                                                nullptr) const
+      -> vector<index_type> {
+    const auto target = face_barycenter(dst);
+    return alt_shortest_path(
+        faces.size(), src, dst, face_landmarks,
+        [this](index_type x, auto&& f) { for_each_face_edge(x, f); },
+        [&](index_type x) {
+          return glm::distance(face_barycenter(x), target);
+        },
+        statistics);
+  }
 
-    // Compute count and path.
-    size_t count = 0;
-    for (auto i = dst; i != src; i = previous[i]) ++count;
-    vector<size_t> path(count);
-    for (auto i = dst; i != src; i = previous[i]) path[--count] = i;
-    return path;
+  auto compute_shortest_face_path_bidirectional(
+      index_type src,
+      index_type dst,
+      search_statistics* statistics = nullptr) const -> vector<index_type> {
+    return bidirectional_shortest_path(
+        faces.size(), src, dst,
+        [this](index_type x, auto&& f) { for_each_face_edge(x, f); },
+        statistics);
   }
 
-  auto compute_shortest_face_path_fast(size_t src, size_t dst) const
-      -> vector<size_t> {
-    const auto barycenter = [&](size_t fid) {
-      const auto& f = faces[fid];
-      return (vertices[f[0]].position + vertices[f[1]].position +
-              vertices[f[2]].position) /
-             3.0f;
-    };
-    const auto face_distance = [&](size_t i, size_t j) {
-      return glm::distance(barycenter(i), barycenter(j));
-    };
+  auto compute_shortest_path(path_search method,
+                             index_type src,
+                             index_type dst,
+                             search_statistics* statistics = nullptr) const
+      -> vector<index_type> {
+    switch (method) {
+      case path_search::astar:
+        return compute_shortest_path_astar(src, dst, statistics);
+      case path_search::bidirectional:
+        return compute_shortest_path_bidirectional(src, dst, statistics);
+      case path_search::landmarks:
+        return compute_shortest_path_landmarks(src, dst, statistics);
+      default:
+        return compute_shortest_path_fast(src, dst, statistics);
+    }
+  }
 
-    vector<bool> visited(faces.size(), false);
+  auto compute_shortest_face_path(path_search method,
+                                  index_type src,
+                                  index_type dst,
+                                  search_statistics* statistics = nullptr) const
+      -> vector<index_type> {
+    switch (method) {
+      case path_search::astar:
+        return compute_shortest_face_path_astar(src, dst, statistics);
+      case path_search::bidirectional:
+        return compute_shortest_face_path_bidirectional(src, dst, statistics);
+      case path_search::landmarks:
+        return compute_shortest_face_path_landmarks(src, dst, statistics);
+      default:
+        return compute_shortest_face_path_fast(src, dst, statistics);
+    }
+  }
 
-    vector<float> distances(faces.size(), INFINITY);
-    distances[src] = 0;
+  // Choose landmarks on the vertex and the face graph for the ALT searches.
+  // Both graphs are processed in parallel. Like the heat method,
+  // landmarks are cleared when vertices are moved and have to be
+  // computed again.
+  void compute_landmarks(size_t count) {
+    parallel_for(0, 2, [&](size_t i) {
+      if (i == 0)
+        vertex_landmarks.build(
+            vertices.size(), count,
+            [this](index_type x, auto&& f) { for_each_vertex_edge(x, f); });
+      else
+        face_landmarks.build(
+            faces.size(), count,
+            [this](index_type x, auto&& f) { for_each_face_edge(x, f); });
+    });
+  }
 
-    vector<size_t> previous(faces.size());
-    previous[src] = src;
+  // Factorize the operators of the heat method for geodesic distances.
+  // They have to be recomputed after vertices have been moved.
+  bool compute_heat_method(float time_factor = 1.0f) {
+    vector<vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) positions[i] = position(i);
+    return geodesics.build(positions, faces, time_factor);
+  }
 
-    vector<size_t> queue{src};
-    const auto order = [&](size_t i, size_t j) {
-      return distances[i] > distances[j];
+  // Curve on the surface from the vertex 'from' along the steepest descent
+  // of 'distances' to a local minimum, usually the closest source.
+  // Inside faces, the gradient is constant and the curve is straight.
+  // If the gradients of two faces point against their shared edge,
+  // the curve follows the edge to its lower vertex. From vertices,
+  // it enters the incident face whose gradient points into it
+  // or follows the steepest edge. Needs the heat method and topology.
+  auto trace_geodesic(const vector<float>& distances, index_type from) const
+      -> vector<vec3> {
+    const auto minimum = [&](index_type v) {
+      for (auto i = neighbor_offset[v]; i < neighbor_offset[v + 1]; ++i)
+        if (distances[neighbors[i]] < distances[v]) return false;
+      return true;
+    };
+    // Change of the barycentric coordinates along the descent in a face
+    const auto descent = [&](index_type f) {
+      const auto& g = geodesics.barycentric_gradients(f);
+      const auto d = -geodesics.gradient(f, distances);
+      return vec3{dot(g[0], d), dot(g[1], d), dot(g[2], d)};
+    };
+    const auto point = [&](index_type f, const vec3& b) {
+      const auto& x = faces[f];
+      return b[0] * position(x[0]) + b[1] * position(x[1]) +
+             b[2] * position(x[2]);
     };
 
-    do {
-      ranges::make_heap(queue, order);
-      ranges::pop_heap(queue, order);
-      const auto current = queue.back();
-      queue.pop_back();
-
-      // cout << "current = " << current << endl;
-
-      visited[current] = true;
-
-      const auto neighbor_faces = face_neighbors[current];
-      for (size_t i = 0; i < 3; ++i) {
-        const auto neighbor = neighbor_faces[i];
-        if (visited[neighbor]) continue;
-
-        const auto d = face_distance(current, neighbor) + distances[current];
-        if (d >= distances[neighbor]) continue;
+    vector<vec3> curve{position(from)};
+    // The curve is either at the vertex 'v' or inside the face 'f'
+    // at the barycentric coordinates 'b'.
+    auto v = from;
+    index_type f = invalid_index;
+    vec3 b{};
+    const auto max_steps = 2 * (faces.size() + vertices.size());
+    for (size_t step = 0; step < max_steps; ++step) {
+      if (v != invalid_index) {
+        if (minimum(v)) break;
+        f = invalid_index;
+        for (auto i = outgoing_offset[v]; i < outgoing_offset[v + 1]; ++i) {
+          const auto h = outgoing[i];
+          const auto k = h % 3;
+          const auto d = descent(h / 3);
+          if ((d[k] < 0.0f) && (d[(k + 1) % 3] >= 0.0f) &&
+              (d[(k + 2) % 3] >= 0.0f)) {
+            f = h / 3;
+            b = {};
+            b[k] = 1.0f;
+            break;
+          }
+        }
+        if (f == invalid_index) {
+          auto next = v;
+          float slope = 0.0f;
+          for (auto i = neighbor_offset[v]; i < neighbor_offset[v + 1]; ++i) {
+            const auto w = neighbors[i];
+            const auto s = (distances[v] - distances[w]) / distance(v, w);
+            if (s <= slope) continue;
+            slope = s;
+            next = w;
+          }
+          if (next == v) break;
+          v = next;
+          curve.push_back(position(v));
+          continue;
+        }
+        v = invalid_index;
+      }
 
-        distances[neighbor] = d;
-        previous[neighbor] = current;
-        queue.push_back(neighbor);
+      // Sources are reached on a straight line inside their faces.
+      bool reached = false;
+      for (auto x : faces[f]) {
+        if (!minimum(x)) continue;
+        curve.push_back(position(x));
+        reached = true;
+        break;
+      }
+      if (reached) break;
+
+      // Walk to the edge where the first barycentric coordinate vanishes.
+      const auto d = descent(f);
+      float t = INFINITY;
+      int exit = -1;
+      for (int k = 0; k < 3; ++k) {
+        if (d[k] >= 0.0f) continue;
+        const auto s = -b[k] / d[k];
+        if (s >= t) continue;
+        t = s;
+        exit = k;
+      }
+      if (exit < 0) break;
+      b = glm::max(b + t * d, vec3{0.0f});
+      b[exit] = 0.0f;
+      b /= b[0] + b[1] + b[2];
+      curve.push_back(point(f, b));
+
+      constexpr float vertex_tolerance = 1e-4f;
+      for (int k = 0; k < 3; ++k)
+        if (b[k] > 1.0f - vertex_tolerance) v = faces[f][k];
+      if (v != invalid_index) {
+        curve.back() = position(v);
+        continue;
       }
-    } while (!queue.empty() && !visited[dst]);
 
-    if (queue.empty()) return {};
+      const auto x = faces[f][(exit + 1) % 3];
+      const auto y = faces[f][(exit + 2) % 3];
+      const auto lower = (distances[x] < distances[y]) ? x : y;
+      const auto g = face_neighbors[f][exit];
+      vec3 c{};
+      int opposite = 0;
+      if (g != invalid_index) {
+        for (int k = 0; k < 3; ++k) {
+          if (faces[g][k] == x)
+            c[k] = b[(exit + 1) % 3];
+          else if (faces[g][k] == y)
+            c[k] = b[(exit + 2) % 3];
+          else
+            opposite = k;
+        }
+      }
+      if ((g == invalid_index) || (descent(g)[opposite] <= 0.0f)) {
+        v = lower;
+        curve.push_back(position(v));
+        continue;
+      }
+      f = g;
+      b = c;
+    }
+    return curve;
+  }
 
-    // Compute count and path.
-    size_t count = 0;
-    for (auto i = dst; i != src; i = previous[i]) ++count;
-    vector<size_t> path(count);
-    for (auto i = dst; i != src; i = previous[i]) path[--count] = i;
-    return path;
+  // Straighten a path of vertices, for example, from
+  // 'compute_shortest_path_fast', into a locally shortest geodesic
+  // by intrinsic edge flips. The path has to contain its source.
+  // The mesh itself is not changed. Needs the half-edges.
+  auto straighten_path(const vector<index_type>& path,
+                       straightening_statistics* statistics = nullptr) const
+      -> vector<vec3> {
+    vector<vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) positions[i] = position(i);
+    intrinsic_triangulation triangulation{positions, faces, twins};
+    return triangulation.straighten(path, statistics);
   }
 
-  vector<vertex> vertices{};
+  V vertices{};
   vector<face> faces{};
   int material_id = -1;
 
   static constexpr auto pair_hasher = [](const auto& x) {
-    return (x.first << 7) ^ x.second;
+    return (size_t(x.first) << 7) ^ x.second;
   };
-  unordered_map<pair<size_t, size_t>, edge_info, decltype(pair_hasher)> edges{};
-  unordered_map<pair<size_t, size_t>, dual_info, decltype(pair_hasher)>
-      dual_edges{};
+  unordered_map<pair<index_type, index_type>,
+                edge_info,
+                decltype(pair_hasher)>
+      edges{};
   // map<pair<size_t, size_t>, int> edges{};
-  vector<size_t> neighbor_offset{};
-  vector<size_t> neighbors{};
-  vector<array<size_t, 3>> face_neighbors{};
+  vector<index_type> neighbor_offset{};
+  vector<index_type> neighbors{};
+  vector<array<index_type, 3>> face_neighbors{};
+  // Dual graph
+  vector<vec3> face_barycenters{};
+  vector<index_type> dual_offset{};
+  vector<dual_edge> dual_edges{};
+  vector<array<index_type, 2>> dual_edge_vertices{};
+  topology_diagnostics diagnostics{};
+  vector<cluster> clusters{};
+  vector<index_type> cluster_faces{};
+  vector<lod_level> lods{};
+  vector<face> lod_faces{};
+
+  // Half-edge topology
+  vector<index_type> twins{};
+  vector<index_type> outgoing_offset{};
+  vector<index_type> outgoing{};
+
+  bvh face_bvh{};
+  triangle_soa face_soa{};
+  vector<index_type> vertex_face_offset{};
+  vector<index_type> vertex_faces{};
+  float bvh_rebuild_threshold = 1.5f;
+
+  kd_tree vertex_tree{};
+  heat_method geodesics{};
+  landmarks<index_type> vertex_landmarks{};
+  landmarks<index_type> face_landmarks{};
 };
 
+using basic_mesh = basic_indexed_mesh<>;
+using basic_soa_mesh = basic_indexed_mesh<uint32, vertex_soa>;
+
+// Mesh with its vertices and faces uploaded to the GPU.
+// The layout on the GPU is chosen at runtime. With 'soa_vertices',
+// positions, normals and texture coordinates are uploaded
+// to separate buffers. Packed vertices are always interleaved.
 struct mesh : basic_mesh {
   static constexpr GLint position_attribute_location = 0;
   static constexpr GLint normal_attribute_location = 1;
@@ -414,7 +1596,13 @@ struct mesh : basic_mesh {
   void setup() noexcept {
     // device_handle.bind();
     device_vertices.bind();
-    device_handle.template setup_aos<vertex_data>();
+    if (packed_vertices)
+      device_handle.template setup_aos<packed_vertex_data>();
+    else if (soa_vertices)
+      device_handle.template setup_soa<vertex_data>(
+          device_vertices, device_normals, device_uvs);
+    else
+      device_handle.template setup_aos<vertex_data>();
     device_faces.bind();
 
     // glEnableVertexAttribArray(position_attribute_location);
@@ -442,21 +1630,183 @@ struct mesh : basic_mesh {
     // device_vertices.initialize(vertices.data(), vertices.size());
     // device_faces.initialize(faces.data(), faces.size());
 
-    device_vertices.allocate_and_initialize(vertices);
-    device_faces.allocate_and_initialize(faces);
+    if (packed_vertices) {
+      compute_quantization();
+      device_vertices.allocate_and_initialize(pack(0, vertices.size()));
+    } else if (soa_vertices) {
+      const auto x = attributes(0, vertices.size());
+      device_vertices.allocate_and_initialize(x.positions);
+      device_normals.allocate_and_initialize(x.normals);
+      device_uvs.allocate_and_initialize(x.uvs);
+    } else
+      device_vertices.allocate_and_initialize(vertices);
+    update_faces();
 
     // device_vertices = vertices;
     // device_faces = faces;
   }
 
-  void render() const noexcept {
+  // Upload and refit only the vertices in the range [first, last)
+  // for streamed deformations with unchanged topology.
+  // Packed vertices leaving the quantization box require a full upload.
+  // Returns whether the BVH had to be rebuilt.
+  bool update(size_t first, size_t last) {
+    if (packed_vertices) {
+      if (quantizable(first, last))
+        device_vertices.write(pack(first, last), first * sizeof(packed_vertex));
+      else
+        update();
+    } else if (soa_vertices) {
+      const auto x = attributes(first, last);
+      device_vertices.write(x.positions, first * sizeof(vec3));
+      device_normals.write(x.normals, first * sizeof(vec3));
+      device_uvs.write(x.uvs, first * sizeof(vec2));
+    } else
+      device_vertices.write(vertices.data() + first, last - first,
+                            first * sizeof(vertex));
+    // The operators of the heat method depend on all positions.
+    geodesics = {};
+    // Landmark distances would no longer be lower bounds. Without them,
+    // the ALT search falls back to the Euclidean A* search.
+    vertex_landmarks = {};
+    face_landmarks = {};
+    refit_dual_graph(first, last);
+    // Culling tests of clusters use their bounds and normal cones.
+    refit_clusters(first, last);
+    vertex_tree.refit(first, last, [this](size_t i) { return position(i); });
+    return refit_bvh(first, last);
+  }
+
+  void update_faces() noexcept {
+    device_faces.allocate_and_initialize(faces);
+    update_lods();
+  }
+
+  // Levels of detail have their own buffer. So, they can be
+  // swapped in later without uploading the original faces again.
+  void update_lods() noexcept {
+    device_lod_faces.allocate_and_initialize(lod_faces);
+  }
+
+  // Switch the GPU layout of the vertices and upload them again.
+  void set_packed_vertices(bool packed) {
+    packed_vertices = packed;
+    setup();
+    update();
+  }
+
+  void set_soa_vertices(bool enable) {
+    soa_vertices = enable;
+    setup();
+    update();
+  }
+
+  // Vertices in [first, last) split into their attributes
+  auto attributes(size_t first, size_t last) const -> vertex_soa {
+    vertex_soa result{};
+    result.resize(last - first);
+    parallel_for(
+        first, last, [&](size_t i) { result[i - first] = vertices[i]; },
+        1 << 14);
+    return result;
+  }
+
+  // Shaders need to know how to restore packed vertices.
+  void set_uniforms(shader_program& shader) const noexcept {
+    shader  //
+        .try_set("packed_vertices", GLint(packed_vertices))
+        .try_set("position_offset", position_offset)
+        .try_set("position_scale", position_scale);
+  }
+
+  void compute_quantization() noexcept {
+    aabb box{};
+    for (const auto& v : vertices) box.extend(v.position);
+    position_offset = box.empty() ? vec3{} : box.min;
+    // Flat meshes still need a non-zero scale.
+    position_scale = glm::max(box.empty() ? vec3{} : box.size(), vec3{1e-6f});
+  }
+
+  bool quantizable(size_t first, size_t last) const noexcept {
+    for (auto i = first; i < last; ++i) {
+      const auto p = (vertices[i].position - position_offset) / position_scale;
+      if ((min(p.x, min(p.y, p.z)) < 0.0f) || (max(p.x, max(p.y, p.z)) > 1.0f))
+        return false;
+    }
+    return true;
+  }
+
+  auto pack(const vertex& v) const noexcept -> packed_vertex {
+    const auto p = glm::clamp((v.position - position_offset) / position_scale,
+                              0.0f, 1.0f);
+    const auto n = octahedral_encode(normalize(v.normal));
+    return {{{uint16_t(std::round(65535.0f * p.x)),
+              uint16_t(std::round(65535.0f * p.y)),
+              uint16_t(std::round(65535.0f * p.z)), 0}},
+            {{int16_t(std::round(32767.0f * std::clamp(n.x, -1.0f, 1.0f))),
+              int16_t(std::round(32767.0f * std::clamp(n.y, -1.0f, 1.0f)))}},
+            {glm::packHalf2x16(v.uv)}};
+  }
+
+  auto pack(size_t first, size_t last) const -> vector<packed_vertex> {
+    vector<packed_vertex> result(last - first);
+    parallel_for(
+        first, last, [&](size_t i) { result[i - first] = pack(vertices[i]); },
+        1 << 14);
+    return result;
+  }
+
+  // Inverse of 'pack' as evaluated by the shaders
+  auto unpack(const packed_vertex& x) const noexcept -> vertex {
+    const auto p = vec3(x.position.value) / 65535.0f;
+    const auto n = glm::max(vec2(x.normal.value) / 32767.0f, -1.0f);
+    return {position_offset + position_scale * p, octahedral_decode(n),
+            glm::unpackHalf2x16(x.uv.bits)};
+  }
+
+  // Largest distance of positions and largest angle of normals
+  // between the vertices and their packed round trip
+  auto packing_error() const -> pair<float, float> {
+    float position_error = 0.0f;
+    float normal_error = 0.0f;
+    for (const auto& v : vertices) {
+      const auto u = unpack(pack(v));
+      const auto d = glm::distance(u.position, v.position);
+      const auto c = std::clamp(dot(u.normal, normalize(v.normal)), -1.0f, 1.0f);
+      position_error = std::max(position_error, d);
+      normal_error = std::max(normal_error, std::acos(c));
+    }
+    return {position_error, normal_error};
+  }
+
+  // Draw the given level of detail as returned by 'lod'.
+  void render(size_t level = 0) const noexcept {
+    // The bound element buffer is part of the vertex array state.
     device_handle.bind();
-    glDrawElements(GL_TRIANGLES, 3 * faces.size(), GL_UNSIGNED_INT, 0);
+    if (level == 0) {
+      device_faces.bind();
+      glDrawElements(GL_TRIANGLES, 3 * faces.size(), GL_UNSIGNED_INT, 0);
+      return;
+    }
+    const auto& l = lods[level - 1];
+    device_lod_faces.bind();
+    glDrawElements(GL_TRIANGLES, 3 * l.count, GL_UNSIGNED_INT,
+                   (void*)(l.offset * sizeof(face)));
   }
 
   vertex_array device_handle{};
   vertex_buffer device_vertices{};
+  // Only used for 'soa_vertices' where 'device_vertices' stores the positions
+  vertex_buffer device_normals{};
+  vertex_buffer device_uvs{};
   element_buffer device_faces{};
+  element_buffer device_lod_faces{};
+
+  bool packed_vertices = false;
+  bool soa_vertices = false;
+  // Packed positions p in [0, 1]^3 are given by 'offset + scale * p'.
+  vec3 position_offset{};
+  vec3 position_scale{1.0f};
 };
 
 struct points {
@@ -624,7 +1974,31 @@ struct scene {
     textures.emplace("", move(texture));
   }
 
-  void update() {
+  // Time spent in the stages of 'update'.
+  // CPU stages are summed over all meshes and their tasks may overlap.
+  // So, only 'total' is measured in wall-clock time.
+  struct update_timings {
+    float textures{};
+    float uploads{};
+    float topology{};
+    float boundaries{};
+    float clusters{};
+    float dual_graph{};
+    float bvh{};
+    float vertex_tree{};
+    float total{};
+    // Number of meshes whose topology has been read from the cache
+    size_t cached_topologies{};
+  };
+
+  // All OpenGL calls are done by the calling thread
+  // which must own the context. The CPU-side preprocessing of every mesh
+  // is split into independent tasks running on the thread pool.
+  // Levels of detail are only started and swapped in by 'commit_lods'.
+  auto update() -> update_timings {
+    const auto start = clock::now();
+    update_timings timings{};
+
     for (auto& material : materials) {
       // if (material.texture_path.empty()) {
       //   material.device_texture = 0;
@@ -666,24 +2040,184 @@ struct scene {
       textures.emplace(material.texture_path, move(texture));
     }
 
-    boundaries.resize(meshes.size());
-    for (size_t i = 0; i < meshes.size(); ++i) {
-      auto& mesh = meshes[i];
+    const auto textures_done = clock::now();
+    timings.textures = duration<float>(textures_done - start).count();
+
+    for (auto& mesh : meshes) {
+      if ((mesh.packed_vertices != packed_vertices) ||
+          (mesh.soa_vertices != soa_vertices)) {
+        mesh.packed_vertices = packed_vertices;
+        mesh.soa_vertices = soa_vertices;
+        mesh.setup();
+      }
+      // Levels of detail of previous contents are stale.
+      mesh.set_lods({});
       mesh.update();
-      mesh.compute_edges();
-      mesh.compute_neighbors();
-
-      auto& boundary = boundaries[i];
-      for (const auto& [e, info] : mesh.edges) {
-        if (info.inside()) continue;
-        const auto [p, q] = e;
-        boundary.vertices.push_back(mesh.vertices[p].position);
-        boundary.vertices.push_back(mesh.vertices[q].position);
+    }
+    const auto uploads_done = clock::now();
+    timings.uploads = duration<float>(uploads_done - textures_done).count();
+
+    // Topology, BVH and vertex tree of a mesh only read its vertices
+    // and faces and write distinct members. Hence, they run as three tasks
+    // per mesh. Large meshes are started first to balance the load.
+    // Stages themselves use the pool for large meshes.
+    constexpr size_t tasks = 3;
+    vector<uint32> order(meshes.size());
+    for (uint32 i = 0; i < order.size(); ++i) order[i] = i;
+    ranges::sort(order, [&](uint32 i, uint32 j) {
+      return meshes[i].faces.size() > meshes[j].faces.size();
+    });
+
+    boundaries.resize(meshes.size());
+    vector<update_timings> mesh_timings(meshes.size());
+    parallel_for(0, tasks * meshes.size(), [&](size_t task) {
+      const auto id = order[task / tasks];
+      auto& mesh = meshes[id];
+      auto& time = mesh_timings[id];
+      const auto t0 = clock::now();
+      switch (task % tasks) {
+        case 0: {
+          auto& boundary = boundaries[id].vertices;
+          const auto hash =
+              topology_cache.enabled() ? mesh.content_hash() : uint64{};
+          if (topology_cache.load(hash, mesh, boundary)) {
+            time.cached_topologies = 1;
+          } else {
+            mesh.compute_half_edges();
+            mesh.compute_neighbors();
+            const auto t1 = clock::now();
+            boundary.clear();
+            compute_boundary(id);
+            time.boundaries = duration<float>(clock::now() - t1).count();
+            topology_cache.store(hash, mesh, boundary);
+          }
+          const auto t2 = clock::now();
+          time.topology = duration<float>(t2 - t0).count() - time.boundaries;
+          mesh.compute_clusters();
+          const auto t3 = clock::now();
+          time.clusters = duration<float>(t3 - t2).count();
+          mesh.compute_dual_graph();
+          time.dual_graph = duration<float>(clock::now() - t3).count();
+          break;
+        }
+        case 1:
+          mesh.compute_bvh();
+          time.bvh = duration<float>(clock::now() - t0).count();
+          break;
+        case 2:
+          mesh.compute_vertex_tree();
+          time.vertex_tree = duration<float>(clock::now() - t0).count();
+          break;
       }
-      boundary.update();
+    });
+
+    for (const auto& time : mesh_timings) {
+      timings.topology += time.topology;
+      timings.boundaries += time.boundaries;
+      timings.clusters += time.clusters;
+      timings.dual_graph += time.dual_graph;
+      timings.bvh += time.bvh;
+      timings.vertex_tree += time.vertex_tree;
+      timings.cached_topologies += time.cached_topologies;
+    }
+
+    for (auto& boundary : boundaries) boundary.update();
+    compute_bvh();
+    build_lods();
+
+    timings.total = duration<float>(clock::now() - start).count();
+    return timings;
+  }
+
+  // Levels of detail of all meshes built by 'build_lods'
+  // together with the sizes of the meshes they have been built for
+  struct lod_result {
+    vector<mesh::lod_chain> chains{};
+    vector<array<size_t, 2>> sizes{};
+    float time{};
+  };
+
+  // Simplification takes longer than all other stages of 'update'
+  // but levels of detail are only an optimization for drawing.
+  // So, they are built by a single task of the pool from copies
+  // of the meshes while the original faces are drawn.
+  // One task keeps the other threads free for interactive queries.
+  // Results of a previous build are discarded.
+  void build_lods() {
+    struct input {
+      decltype(mesh::vertices) vertices;
+      vector<face> faces;
+    };
+    vector<input> inputs{};
+    inputs.reserve(meshes.size());
+    for (const auto& mesh : meshes)
+      inputs.push_back({mesh.vertices, mesh.faces});
+    pending_lods = default_thread_pool().async([inputs = move(inputs)] {
+      const auto start = clock::now();
+      lod_result result{};
+      for (const auto& [vertices, faces] : inputs) {
+        result.chains.push_back(mesh::simplify_lods(vertices, faces));
+        result.sizes.push_back({vertices.size(), faces.size()});
+      }
+      result.time = duration<float>(clock::now() - start).count();
+      return result;
+    });
+  }
+
+  // Swap in the levels of detail if their build has finished
+  // or if 'wait' is set. Only their own buffers are uploaded.
+  // Chains of meshes whose sizes changed in between are dropped.
+  // Returns the build time in seconds or a negative value
+  // if nothing has been swapped in.
+  auto commit_lods(bool wait = false) -> float {
+    if (!pending_lods.valid()) return -1.0f;
+    if (!wait && (pending_lods.wait_for(0s) != future_status::ready))
+      return -1.0f;
+    auto result = pending_lods.get();
+    for (size_t i = 0; i < std::min(meshes.size(), result.chains.size());
+         ++i) {
+      auto& mesh = meshes[i];
+      const array<size_t, 2> sizes{mesh.vertices.size(), mesh.faces.size()};
+      if (sizes != result.sizes[i]) continue;
+      mesh.set_lods(move(result.chains[i]));
+      mesh.update_lods();
+    }
+    return result.time;
+  }
+
+  // Boundary segments are given by all half-edges without twin.
+  // This includes non-manifold edges and edges between
+  // inconsistently oriented faces.
+  void compute_boundary(size_t id) {
+    const auto& mesh = meshes[id];
+    auto& boundary = boundaries[id];
+    for (uint32 h = 0; h < mesh.twins.size(); ++h) {
+      if (mesh.twin(h) != mesh.invalid_half_edge) continue;
+      boundary.vertices.push_back(mesh.vertices[mesh.origin(h)].position);
+      boundary.vertices.push_back(mesh.vertices[mesh.target(h)].position);
     }
   }
 
+  void set_packed_vertices(bool packed) {
+    packed_vertices = packed;
+    for (auto& mesh : meshes) mesh.set_packed_vertices(packed);
+  }
+
+  void set_soa_vertices(bool enable) {
+    soa_vertices = enable;
+    for (auto& mesh : meshes) mesh.set_soa_vertices(enable);
+  }
+
+  // Memory of all vertex buffers on the GPU in bytes
+  auto vertex_memory() const noexcept -> size_t {
+    size_t result = 0;
+    for (const auto& mesh : meshes)
+      result += mesh.vertices.size() * (mesh.packed_vertices
+                                            ? sizeof(packed_vertex)
+                                            : sizeof(vertex));
+    return result;
+  }
+
   void set_uniforms(shader_program& shader) const noexcept {
     shader.bind();
     shader.try_set("model", model_matrix);
@@ -695,6 +2229,7 @@ struct scene {
   void render(shader_program& shader, const mesh& m) const noexcept {
     set_uniforms(shader);
     materials[m.material_id].bind(shader);
+    m.set_uniforms(shader);
     m.render();
   }
 
@@ -702,10 +2237,37 @@ struct scene {
     set_uniforms(shader);
     for (const auto& mesh : meshes) {
       materials[mesh.material_id].bind(shader);
+      mesh.set_uniforms(shader);
       mesh.render();
     }
   }
 
+  // Draw every mesh at the level of detail chosen for the camera.
+  void render(shader_program& shader, const camera& cam) const noexcept {
+    set_uniforms(shader);
+    for (const auto& mesh : meshes) {
+      materials[mesh.material_id].bind(shader);
+      mesh.set_uniforms(shader);
+      mesh.render(lod(mesh, cam));
+    }
+  }
+
+  // The error of a level is projected at the point of the bounding sphere
+  // nearest to the camera. The coarsest level whose error stays below
+  // 'lod_pixel_error' pixels is chosen.
+  auto lod(const mesh& m, const camera& cam) const noexcept -> size_t {
+    if ((lod_pixel_error <= 0.0f) || m.lods.empty()) return 0;
+    const auto box = m.bounds();
+    const auto scale = std::max({length(vec3(model_matrix[0])),
+                                 length(vec3(model_matrix[1])),
+                                 length(vec3(model_matrix[2]))});
+    const auto center = vec3(model_matrix * vec4(box.center(), 1.0f));
+    const auto radius = 0.5f * scale * length(box.size());
+    const auto d = std::max(glm::distance(center, cam.position()) - radius,
+                            cam.near());
+    return m.lod(lod_pixel_error * d * cam.pixel_size() / scale);
+  }
+
   void render_boundaries() const noexcept {
     for (const auto& boundary : boundaries) boundary.render();
   }
@@ -716,20 +2278,147 @@ struct scene {
 
   struct intersection : mesh::intersection {
     operator bool() const noexcept { return mesh_id != -1; }
+
+    void assign(size_t id, const mesh::intersection& p) noexcept {
+      mesh_id = id;
+      face_id = p.face_id;
+      u = p.u;
+      v = p.v;
+      t = p.t;
+    }
+
     size_t mesh_id = -1;
   };
 
-  auto intersect(const ray& r) -> intersection {
+  // Rays are given in world space whereas meshes and their BVHs
+  // live in object space. Transforming the ray by the inverse model matrix
+  // preserves its parameterization. Hence, all distances 't' stay valid.
+  auto object_ray(const ray& r) const noexcept -> ray {
+    const auto inverse_model_matrix = inverse(model_matrix);
+    return {vec3(inverse_model_matrix * vec4(r.origin, 1.0f)),
+            vec3(inverse_model_matrix * vec4(r.direction, 0.0f))};
+  }
+
+  // The top-level BVH is built over the object-space bounds of all meshes.
+  // As all meshes share the same model matrix, changes of the transform
+  // do not require a rebuild. Only changes of the mesh set do.
+  void compute_bvh() {
+    vector<aabb> bounds(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      bounds[i] = meshes[i].bounds();
+      // Meshes without faces get a point box so the build stays well-defined.
+      if (bounds[i].empty()) bounds[i].extend(vec3{});
+    }
+    mesh_bvh.build(bounds);
+  }
+
+  // Refit the top-level BVH after the given mesh has been deformed,
+  // for example, by 'mesh::update(first, last)'.
+  void refit_bvh(size_t mesh_id) {
+    if (mesh_bvh.empty()) return compute_bvh();
+    mesh_bvh.refit(
+        [this](uint32 i) {
+          auto box = meshes[i].bounds();
+          if (box.empty()) box.extend(vec3{});
+          return box;
+        },
+        {uint32(mesh_id)});
+    if (mesh_bvh.degradation() > bvh_rebuild_threshold) compute_bvh();
+  }
+
+  auto intersect(const ray& r) const -> intersection {
+    const auto local = object_ray(r);
+    intersection result{};
+    if (mesh_bvh.empty()) {
+      for (size_t i = 0; i < meshes.size(); ++i) {
+        const auto p = meshes[i].intersect(local, result.t);
+        if (p) result.assign(i, p);
+      }
+      return result;
+    }
+
+    mesh_bvh.traverse(local, result.t, [&](uint32 i, float& t_max) {
+      const auto p = meshes[i].intersect(local, t_max);
+      if (!p) return;
+      result.assign(i, p);
+      t_max = p.t;
+    });
+    return result;
+  }
+
+  // Exact test of a single face, for example,
+  // to refine a candidate given by a pick buffer.
+  auto intersect(const ray& r, size_t mesh_id, size_t face_id) const
+      -> intersection {
+    intersection result{};
+    mesh::intersection p{};
+    if (!viewer::intersect(object_ray(r), meshes[mesh_id].face_triangle(face_id), p))
+      return result;
+    p.face_id = face_id;
+    result.assign(mesh_id, p);
+    return result;
+  }
+
+  // Closest hits of coherent rays, for example, sorted along
+  // a Morton curve. Rays are traced in packets of eight rays
+  // for the AVX2 kernel and of four rays otherwise.
+  void intersect(span<const ray> rays, span<intersection> results) const {
+    const auto kernel = active_intersection_kernel.load(memory_order_relaxed);
+    const size_t n = (kernel == intersection_kernel::avx2) ? 8 : 4;
+    for (size_t i = 0; i < rays.size(); i += n) {
+      const auto count = std::min(n, rays.size() - i);
+      if (n == 8)
+        intersect<8>(rays.subspan(i, count), results.subspan(i, count),
+                     kernel);
+      else
+        intersect<4>(rays.subspan(i, count), results.subspan(i, count),
+                     kernel);
+    }
+  }
+
+  // Up to 'N' rays are traced as one packet through the BVH of the scene
+  // and the BVHs of the meshes. Missing lanes repeat the last ray.
+  template <size_t N>
+  void intersect(span<const ray> rays,
+                 span<intersection> results,
+                 intersection_kernel kernel) const {
+    const auto inverse_model_matrix = inverse(model_matrix);
+    ray_packet<N> packet{};
+    for (size_t i = 0; i < N; ++i) {
+      const auto& r = rays[std::min(i, rays.size() - 1)];
+      packet.set(i, {vec3(inverse_model_matrix * vec4(r.origin, 1.0f)),
+                     vec3(inverse_model_matrix * vec4(r.direction, 0.0f))});
+    }
+    intersection_packet<N> uvt{};
+    intersection hits[N]{};
+    const auto test = [&](uint32 id) {
+      size_t face_ids[N];
+      auto mask = meshes[id].intersect(packet, uvt, face_ids, kernel);
+      for (; mask; mask &= mask - 1) {
+        const auto i = countr_zero(mask);
+        hits[i].mesh_id = id;
+        hits[i].face_id = face_ids[i];
+      }
+    };
+    if (mesh_bvh.empty())
+      for (uint32 id = 0; id < meshes.size(); ++id) test(id);
+    else
+      mesh_bvh.traverse(packet, uvt.t, [&](uint32 id, auto&) { test(id); });
+
+    for (size_t i = 0; i < rays.size(); ++i) {
+      results[i] = hits[i];
+      results[i].u = uvt.u[i];
+      results[i].v = uvt.v[i];
+      results[i].t = uvt.t[i];
+    }
+  }
+
+  auto intersect_brute_force(const ray& r) const -> intersection {
+    const auto local = object_ray(r);
     intersection result{};
     for (size_t i = 0; i < meshes.size(); ++i) {
-      const auto p = meshes[i].intersect(r);
-      if (!p) continue;
-      if (p.t >= result.t) continue;
-      result.mesh_id = i;
-      result.face_id = p.face_id;
-      result.u = p.u;
-      result.v = p.v;
-      result.t = p.t;
+      const auto p = meshes[i].intersect_brute_force(local, result.t);
+      if (p) result.assign(i, p);
     }
     return result;
   }
@@ -740,6 +2429,21 @@ struct scene {
   unordered_map<string, texture2> textures{};
   mat4 model_matrix{1.0f};
   mat3 normal_matrix{1.0f};
+
+  bvh mesh_bvh{};
+  float bvh_rebuild_threshold = 1.5f;
+
+  // Upload vertices of all meshes in the layout of 'packed_vertex'.
+  bool packed_vertices = false;
+  // Upload every vertex attribute of all meshes to its own buffer.
+  bool soa_vertices = false;
+  // Screen-space error in pixels tolerated by levels of detail
+  // where zero always draws the original faces.
+  float lod_pixel_error = 1.0f;
+
+  // Topology of unchanged meshes is reused across loads.
+  struct topology_cache topology_cache{};
+  future<lod_result> pending_lods{};
 };
 
 }  // namespace viewer
@@ -13,13 +13,19 @@ layout (location = 0) in vec3 p;
 layout (location = 1) in vec3 n;
 layout (location = 2) in vec2 uv;
 
+// Functions restoring packed vertices spliced in by 'viewer::load_shader'
+#include <packed_vertex>
+
 out vec3 position;
 out vec3 normal;
 out vec2 texuv;
 
 void main(){
-  gl_Position = camera.projection * camera.view * model * vec4(p, 1.0);
-  position = vec3(camera.view * model * vec4(p, 1.0));
-  normal = vec3(camera.view * model * vec4(n, 0.0));
+  vec3 vertex_position = unpack_position(p);
+  vec3 vertex_normal = unpack_normal(n);
+  gl_Position =
+      camera.projection * camera.view * model * vec4(vertex_position, 1.0);
+  position = vec3(camera.view * model * vec4(vertex_position, 1.0));
+  normal = vec3(camera.view * model * vec4(vertex_normal, 0.0));
   texuv = uv;
 }
@@ -21,13 +21,18 @@ layout (location = 0) in vec3 p;
 layout (location = 1) in vec3 n;
 layout (location = 2) in vec2 uv;
 
+// Functions restoring packed vertices spliced in by 'viewer::load_shader'
+#include <packed_vertex>
+
 out vertex_data {
   vec3 normal;
   vec2 texuv;
 } v;
 
 void main(){
-  gl_Position = projection * view * model * vec4(p, 1.0);
-  v.normal = vec3(camera.view * vec4(normal_matrix * n, 0.0));
+  vec3 vertex_position = unpack_position(p);
+  vec3 vertex_normal = unpack_normal(n);
+  gl_Position = projection * view * model * vec4(vertex_position, 1.0);
+  v.normal = vec3(camera.view * vec4(normal_matrix * vertex_normal, 0.0));
   v.texuv = uv;
 }
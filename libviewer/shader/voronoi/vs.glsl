@@ -24,12 +24,18 @@ layout (location = 0) in vec3 p;
 layout (location = 1) in vec3 n;
 layout (location = 2) in vec2 uv;
 
+// Functions restoring packed vertices spliced in by 'viewer::load_shader'
+#include <packed_vertex>
+
 flat out vec3 color;
 
 void main(){
-  gl_Position = camera.projection * camera.view * model * vec4(p, 1.0);
+  vec3 vertex_position = unpack_position(p);
+  vec3 vertex_normal = unpack_normal(n);
+  gl_Position =
+      camera.projection * camera.view * model * vec4(vertex_position, 1.0);
 
-  vec3 normal = vec3(camera.view * vec4(normal_matrix * n, 0.0));
+  vec3 normal = vec3(camera.view * vec4(normal_matrix * vertex_normal, 0.0));
 
   vec3 light_color = vec3(0.3, 0.3, 0.3);
 
@@ -0,0 +1,236 @@
+#pragma once
+#include <queue>
+//
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Symmetric 4x4 matrix of the quadric error metric from Garland and Heckbert,
+// 'Surface Simplification Using Quadric Error Metrics', 1997.
+// Evaluating it at a point sums the squared distances to a set of planes.
+// Double precision avoids cancellation for points far from the origin.
+struct quadric {
+  quadric() = default;
+
+  // Plane through 'p' with unit normal 'n'
+  quadric(const vec3& n, const vec3& p) noexcept {
+    const double a = n.x, b = n.y, c = n.z;
+    const double d = -dot(n, p);
+    q = {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+  }
+
+  auto operator+=(const quadric& x) noexcept -> quadric& {
+    for (size_t i = 0; i < q.size(); ++i) q[i] += x.q[i];
+    return *this;
+  }
+
+  auto operator*=(double s) noexcept -> quadric& {
+    for (auto& x : q) x *= s;
+    return *this;
+  }
+
+  friend auto operator+(quadric x, const quadric& y) noexcept -> quadric {
+    return x += y;
+  }
+
+  auto operator()(const vec3& p) const noexcept -> double {
+    const double x = p.x, y = p.y, z = p.z;
+    return q[0] * x * x + q[4] * y * y + q[7] * z * z + q[9] +
+           2 * (q[1] * x * y + q[2] * x * z + q[3] * x + q[5] * y * z +
+                q[6] * y + q[8] * z);
+  }
+
+  array<double, 10> q{};
+};
+
+template <typename F>
+struct simplification {
+  vector<F> faces{};
+  // Conservative bound of the distance between removed vertices
+  // and the planes of the faces they have been merged over
+  float error{};
+};
+
+// Reduce the faces by half-edge collapses ordered by their quadric error.
+// A collapse moves a vertex onto one of its neighbors. So, the result
+// refers to a subset of the given vertices and can be drawn
+// with the same vertex buffer. Collapses which would flip faces
+// or pinch the surface are rejected. Boundary edges are preserved
+// by additional planes orthogonal to their faces.
+// The algorithm stops at 'target' faces or if no valid collapse is left.
+template <typename F>
+auto simplify(const auto& vertices, const vector<F>& faces, size_t target)
+    -> simplification<F> {
+  constexpr double boundary_weight = 10.0;
+  const auto n = vertices.size();
+  const auto position = [&](uint32 v) { return vertices[v].position; };
+  const auto normal = [&](const F& f) {
+    const auto p = position(f[0]);
+    return cross(position(f[1]) - p, position(f[2]) - p);
+  };
+
+  simplification<F> result{faces, 0.0f};
+  auto& work = result.faces;
+  vector<bool> removed(work.size(), false);
+  size_t face_count = work.size();
+
+  // Incident faces of every vertex grow when vertices are merged.
+  vector<vector<uint32>> incident(n);
+  for (uint32 f = 0; f < work.size(); ++f)
+    for (auto v : work[f]) incident[v].push_back(f);
+
+  // Sorting the undirected keys of all half-edges groups the faces
+  // of every edge. Edges of a single face are on the boundary.
+  // Unlike a hash map, this needs no allocation per edge.
+  const auto key = [](uint64 a, uint64 b) {
+    return (std::min(a, b) << 32) | std::max(a, b);
+  };
+  vector<uint64> edges(3 * work.size());
+  for (size_t f = 0; f < work.size(); ++f)
+    for (int k = 0; k < 3; ++k)
+      edges[3 * f + k] = key(work[f][k], work[f][(k + 1) % 3]);
+  ranges::sort(edges);
+  const auto boundary_edge = [&](uint32 a, uint32 b) {
+    const auto [first, last] = ranges::equal_range(edges, key(a, b));
+    return last - first == 1;
+  };
+
+  vector<quadric> quadrics(n);
+  for (const auto& f : work) {
+    const auto m = normal(f);
+    const auto area = length(m);
+    if (area == 0.0f) continue;
+    const quadric plane{m / area, position(f[0])};
+    for (auto v : f) quadrics[v] += plane;
+    for (int k = 0; k < 3; ++k) {
+      const auto a = f[k];
+      const auto b = f[(k + 1) % 3];
+      if (!boundary_edge(a, b)) continue;
+      const auto e = cross(m, position(b) - position(a));
+      if (length(e) == 0.0f) continue;
+      auto border = quadric{normalize(e), position(a)};
+      border *= boundary_weight;
+      quadrics[a] += border;
+      quadrics[b] += border;
+    }
+  }
+
+  // Entries become invalid when one of their vertices changes.
+  // Instead of removing them, they carry the stamps of their vertices.
+  struct collapse {
+    double cost;
+    uint32 from, to;
+    uint32 from_stamp, to_stamp;
+    bool operator>(const collapse& x) const noexcept { return cost > x.cost; }
+  };
+  priority_queue<collapse, vector<collapse>, greater<>> queue{};
+  vector<uint32> stamps(n, 0);
+  vector<bool> collapsed(n, false);
+  const auto push = [&](uint32 u, uint32 v) {
+    const auto q = quadrics[u] + quadrics[v];
+    queue.push({q(position(v)), u, v, stamps[u], stamps[v]});
+    queue.push({q(position(u)), v, u, stamps[v], stamps[u]});
+  };
+  for (size_t i = 0; i < edges.size(); ++i) {
+    if ((i > 0) && (edges[i] == edges[i - 1])) continue;
+    push(edges[i] >> 32, edges[i] & 0xffffffff);
+  }
+
+  // Marks of visited vertices are reset by advancing the epoch.
+  vector<uint32> marks(n, 0);
+  uint32 epoch = 0;
+  const auto for_each_neighbor = [&](uint32 v, auto&& f) {
+    ++epoch;
+    marks[v] = epoch;
+    for (auto t : incident[v]) {
+      if (removed[t]) continue;
+      for (auto w : work[t]) {
+        if (marks[w] == epoch) continue;
+        marks[w] = epoch;
+        f(w);
+      }
+    }
+  };
+
+  // The link condition keeps the surface manifold. Vertices adjacent
+  // to both 'u' and 'v' must be opposite to a face of the edge.
+  const auto valid = [&](uint32 u, uint32 v) {
+    size_t shared_faces = 0;
+    for (auto t : incident[u]) {
+      if (removed[t]) continue;
+      const auto& f = work[t];
+      if ((f[0] == v) || (f[1] == v) || (f[2] == v)) {
+        ++shared_faces;
+        continue;
+      }
+      auto g = f;
+      for (auto& w : g)
+        if (w == u) w = v;
+      const auto before = normal(f);
+      const auto after = normal(g);
+      // Degenerate faces may not be flipped but must not block collapses.
+      if ((dot(before, after) <= 0.0f) && (dot(before, before) > 0.0f))
+        return false;
+    }
+    if (shared_faces == 0) return false;
+    for_each_neighbor(u, [](uint32) {});
+    marks[u] = marks[v] = 0;
+    size_t shared_neighbors = 0;
+    for (auto t : incident[v]) {
+      if (removed[t]) continue;
+      for (auto w : work[t]) {
+        if (marks[w] != epoch) continue;
+        marks[w] = 0;
+        ++shared_neighbors;
+      }
+    }
+    return shared_neighbors == shared_faces;
+  };
+
+  double error = 0;
+  while ((face_count > target) && !queue.empty()) {
+    const auto c = queue.top();
+    queue.pop();
+    if (collapsed[c.from] || collapsed[c.to] ||
+        (stamps[c.from] != c.from_stamp) || (stamps[c.to] != c.to_stamp))
+      continue;
+    const auto u = c.from;
+    const auto v = c.to;
+    if (!valid(u, v)) continue;
+
+    for (auto t : incident[u]) {
+      if (removed[t]) continue;
+      auto& f = work[t];
+      if ((f[0] == v) || (f[1] == v) || (f[2] == v)) {
+        removed[t] = true;
+        --face_count;
+        continue;
+      }
+      for (auto& w : f)
+        if (w == u) w = v;
+      incident[v].push_back(t);
+    }
+    incident[u] = {};
+    collapsed[u] = true;
+    erase_if(incident[v], [&](uint32 t) { return removed[t]; });
+
+    quadrics[v] += quadrics[u];
+    ++stamps[v];
+    error = std::max(error, c.cost);
+
+    vector<uint32> neighbors{};
+    for_each_neighbor(v, [&](uint32 w) {
+      if (w != v) neighbors.push_back(w);
+    });
+    for (auto w : neighbors) push(v, w);
+  }
+
+  size_t i = 0;
+  for (size_t t = 0; t < work.size(); ++t)
+    if (!removed[t]) work[i++] = work[t];
+  work.resize(i);
+  result.error = std::sqrt(error);
+  return result;
+}
+
+}  // namespace viewer
@@ -0,0 +1,267 @@
+#pragma once
+#include <libviewer/bvh.hpp>
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Symmetric sparse matrix in compressed sparse rows.
+// Both triangles and the diagonal are stored. Columns of rows are sorted.
+struct sparse_matrix {
+  struct entry {
+    uint32 row;
+    uint32 column;
+    double value;
+  };
+
+  sparse_matrix() = default;
+
+  // Matrix of size 'n' given by entries of one triangle.
+  // Every entry is mirrored and duplicates are summed.
+  sparse_matrix(size_t n, vector<entry> entries) : offset(n + 1, 0) {
+    for (auto& e : entries)
+      if (e.row > e.column) swap(e.row, e.column);
+    ranges::sort(entries, [](const entry& x, const entry& y) {
+      return (x.row < y.row) || ((x.row == y.row) && (x.column < y.column));
+    });
+    size_t count = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (count && (entries[count - 1].row == entries[i].row) &&
+          (entries[count - 1].column == entries[i].column)) {
+        entries[count - 1].value += entries[i].value;
+        continue;
+      }
+      entries[count++] = entries[i];
+    }
+    entries.resize(count);
+
+    for (const auto& e : entries) {
+      ++offset[e.row + 1];
+      if (e.row != e.column) ++offset[e.column + 1];
+    }
+    for (size_t i = 1; i <= n; ++i) offset[i] += offset[i - 1];
+    columns.resize(offset[n]);
+    values.resize(offset[n]);
+    // Entries are sorted by rows. So, mirrored entries of a row
+    // with smaller columns are inserted before the others.
+    vector<uint32> next(offset.begin(), offset.end() - 1);
+    for (const auto& e : entries) {
+      if (e.row == e.column) continue;
+      const auto p = next[e.column]++;
+      columns[p] = e.row;
+      values[p] = e.value;
+    }
+    for (const auto& e : entries) {
+      const auto p = next[e.row]++;
+      columns[p] = e.column;
+      values[p] = e.value;
+    }
+  }
+
+  auto size() const noexcept -> size_t {
+    return offset.size() - !offset.empty();
+  }
+  auto nonzeros() const noexcept { return columns.size(); }
+
+  // Index of the diagonal entry of row 'i'
+  auto diagonal(uint32 i) const noexcept -> uint32 {
+    return ranges::lower_bound(columns.begin() + offset[i],
+                               columns.begin() + offset[i + 1], i) -
+           columns.begin();
+  }
+
+  vector<uint32> offset{};
+  vector<uint32> columns{};
+  vector<double> values{};
+};
+
+// Fill-reducing elimination order by geometric nested dissection.
+// Nodes are split at the median of the longest axis of their bounds.
+// Nodes of the lower half with neighbors in the upper half form
+// a separator which is eliminated after both halves. So, the halves
+// cause no fill in each other. For surface meshes, the factor
+// has about O(n log n) nonzeros instead of O(n^1.5) for a banded order.
+inline auto nested_dissection(const sparse_matrix& a,
+                              const vector<vec3>& points,
+                              size_t leaf_size = 64) -> vector<uint32> {
+  const auto n = a.size();
+  vector<uint32> order{};
+  order.reserve(n);
+  // Nodes of the current subsets are labeled by unique tokens.
+  vector<uint32> labels(n, 0);
+  uint32 token = 0;
+
+  const auto dissect = [&](auto& self, vector<uint32> nodes) -> void {
+    if (nodes.size() <= leaf_size) {
+      order.insert(order.end(), nodes.begin(), nodes.end());
+      return;
+    }
+    aabb box{};
+    for (auto i : nodes) box.extend(points[i]);
+    const auto extent = box.size();
+    const int axis = (extent.x >= extent.y)
+                         ? ((extent.x >= extent.z) ? 0 : 2)
+                         : ((extent.y >= extent.z) ? 1 : 2);
+    const auto middle = nodes.begin() + nodes.size() / 2;
+    ranges::nth_element(nodes, middle, [&](uint32 i, uint32 j) {
+      return points[i][axis] < points[j][axis];
+    });
+
+    const auto lower = ++token;
+    const auto upper = ++token;
+    const auto separator = ++token;
+    for (auto i = nodes.begin(); i != middle; ++i) labels[*i] = lower;
+    for (auto i = middle; i != nodes.end(); ++i) labels[*i] = upper;
+    vector<uint32> left{};
+    vector<uint32> border{};
+    for (auto i = nodes.begin(); i != middle; ++i) {
+      bool adjacent = false;
+      for (auto p = a.offset[*i]; p < a.offset[*i + 1]; ++p)
+        adjacent |= (labels[a.columns[p]] == upper);
+      (adjacent ? border : left).push_back(*i);
+    }
+    for (auto i : border) labels[i] = separator;
+    vector<uint32> right(middle, nodes.end());
+    nodes = {};
+
+    self(self, move(left));
+    self(self, move(right));
+    order.insert(order.end(), border.begin(), border.end());
+  };
+
+  vector<uint32> nodes(n);
+  for (uint32 i = 0; i < n; ++i) nodes[i] = i;
+  dissect(dissect, move(nodes));
+  return order;
+}
+
+// Sparse Cholesky factorization P A P^T = L L^T of a symmetric
+// positive definite matrix for a given elimination order.
+// The factor is computed row by row by the up-looking algorithm
+// of Davis, 'Direct Methods for Sparse Linear Systems', 2006.
+// Nonzeros of a row are found by walking up the elimination tree.
+// Columns of 'L' are stored compressed with the diagonal first.
+class sparse_cholesky {
+ public:
+  bool empty() const noexcept { return offset.empty(); }
+  auto size() const noexcept -> size_t {
+    return offset.size() - !offset.empty();
+  }
+  auto nonzeros() const noexcept { return rows.size(); }
+
+  // 'order[k]' is the row of 'a' to be eliminated in step 'k'.
+  // Returns false and stays empty if 'a' is not positive definite.
+  bool factorize(const sparse_matrix& a, const vector<uint32>& order) {
+    constexpr uint32 none = -1;
+    const auto n = a.size();
+    permutation = order;
+    vector<uint32> inverse(n);
+    for (uint32 k = 0; k < n; ++k) inverse[order[k]] = k;
+
+    // Parent of a column is the row of its first off-diagonal nonzero.
+    // Path compression by ancestors keeps the construction almost linear.
+    vector<uint32> parent(n, none);
+    {
+      vector<uint32> ancestor(n, none);
+      for (uint32 k = 0; k < n; ++k) {
+        const auto r = order[k];
+        for (auto p = a.offset[r]; p < a.offset[r + 1]; ++p) {
+          for (auto i = inverse[a.columns[p]]; i < k;) {
+            const auto next = ancestor[i];
+            ancestor[i] = k;
+            if (next == none) parent[i] = k;
+            i = next;
+          }
+        }
+      }
+    }
+
+    // Columns of the nonzeros in row 'k' of 'L' in topological order
+    // are written to 'stack[top, n)' where 'top' is returned.
+    vector<uint32> stack(n);
+    vector<uint32> marks(n, none);
+    const auto reach = [&](uint32 k) {
+      size_t top = n;
+      marks[k] = k;
+      const auto r = order[k];
+      for (auto p = a.offset[r]; p < a.offset[r + 1]; ++p) {
+        auto i = inverse[a.columns[p]];
+        if (i > k) continue;
+        size_t length = 0;
+        for (; marks[i] != k; i = parent[i]) {
+          stack[length++] = i;
+          marks[i] = k;
+        }
+        while (length > 0) stack[--top] = stack[--length];
+      }
+      return top;
+    };
+
+    offset.assign(n + 1, 0);
+    for (uint32 k = 0; k < n; ++k) {
+      for (auto top = reach(k); top < n; ++top) ++offset[stack[top] + 1];
+      ++offset[k + 1];
+    }
+    for (size_t i = 1; i <= n; ++i) offset[i] += offset[i - 1];
+    rows.resize(offset[n]);
+    values.resize(offset[n]);
+
+    ranges::fill(marks, none);
+    vector<uint32> next(offset.begin(), offset.end() - 1);
+    vector<double> x(n, 0.0);
+    for (uint32 k = 0; k < n; ++k) {
+      auto top = reach(k);
+      const auto r = order[k];
+      for (auto p = a.offset[r]; p < a.offset[r + 1]; ++p) {
+        const auto i = inverse[a.columns[p]];
+        if (i <= k) x[i] += a.values[p];
+      }
+      auto d = x[k];
+      x[k] = 0.0;
+      for (; top < n; ++top) {
+        const auto i = stack[top];
+        const auto l = x[i] / values[offset[i]];
+        x[i] = 0.0;
+        for (auto p = offset[i] + 1; p < next[i]; ++p)
+          x[rows[p]] -= values[p] * l;
+        d -= l * l;
+        const auto p = next[i]++;
+        rows[p] = k;
+        values[p] = l;
+      }
+      if (!(d > 0.0)) {
+        *this = {};
+        return false;
+      }
+      const auto p = next[k]++;
+      rows[p] = k;
+      values[p] = std::sqrt(d);
+    }
+    return true;
+  }
+
+  // Solve A x = b in place by forward and backward substitution.
+  void solve(vector<double>& b) const {
+    const auto n = size();
+    vector<double> x(n);
+    for (size_t k = 0; k < n; ++k) x[k] = b[permutation[k]];
+    for (size_t j = 0; j < n; ++j) {
+      x[j] /= values[offset[j]];
+      for (auto p = offset[j] + 1; p < offset[j + 1]; ++p)
+        x[rows[p]] -= values[p] * x[j];
+    }
+    for (size_t j = n; j-- > 0;) {
+      for (auto p = offset[j] + 1; p < offset[j + 1]; ++p)
+        x[j] -= values[p] * x[rows[p]];
+      x[j] /= values[offset[j]];
+    }
+    for (size_t k = 0; k < n; ++k) b[permutation[k]] = x[k];
+  }
+
+ private:
+  vector<uint32> permutation{};
+  vector<uint32> offset{};
+  vector<uint32> rows{};
+  vector<double> values{};
+};
+
+}  // namespace viewer
@@ -0,0 +1,156 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+//
+#include <libviewer/utility.hpp>
+
+namespace viewer {
+
+// Fixed set of worker threads processing a shared queue of tasks.
+// Creating threads for every small parallel job would dominate
+// the cost of the job itself. So, all parallel algorithms
+// of the library reuse the threads of one pool.
+class thread_pool {
+ public:
+  explicit thread_pool(size_t n = std::max(1u, thread::hardware_concurrency())) {
+    workers.reserve(n);
+    for (size_t i = 0; i < n; ++i) workers.emplace_back([this] { run(); });
+  }
+
+  ~thread_pool() {
+    {
+      scoped_lock lock{queue_mutex};
+      stopped = true;
+    }
+    queue_condition.notify_all();
+    for (auto& worker : workers) worker.join();
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  auto size() const noexcept { return workers.size(); }
+
+  template <typename F>
+  auto async(F&& f) -> future<invoke_result_t<F>> {
+    // 'function' needs to be copyable but 'packaged_task' is not.
+    auto task =
+        make_shared<packaged_task<invoke_result_t<F>()>>(std::forward<F>(f));
+    auto result = task->get_future();
+    {
+      scoped_lock lock{queue_mutex};
+      tasks.emplace_back([task] { (*task)(); });
+    }
+    queue_condition.notify_one();
+    return result;
+  }
+
+ private:
+  void run() {
+    while (true) {
+      function<void()> task;
+      {
+        unique_lock lock{queue_mutex};
+        queue_condition.wait(lock, [this] { return stopped || !tasks.empty(); });
+        if (tasks.empty()) return;
+        task = move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  vector<thread> workers{};
+  deque<function<void()>> tasks{};
+  mutex queue_mutex{};
+  condition_variable queue_condition{};
+  bool stopped = false;
+};
+
+inline auto default_thread_pool() -> thread_pool& {
+  static thread_pool pool{};
+  return pool;
+}
+
+// Call 'f(i)' for all 'i' in [first, last) by using all threads of the pool.
+// Indices are handed out in chunks of 'grain' consecutive values.
+// The calling thread takes part in the work and only waits
+// for chunks that are currently processed by other threads.
+// Hence, nested calls from inside pool tasks cannot deadlock.
+// The first exception thrown by 'f' is rethrown after all chunks are done.
+inline void parallel_for(size_t first,
+                         size_t last,
+                         auto&& f,
+                         size_t grain = 1,
+                         thread_pool& pool = default_thread_pool()) {
+  if (first >= last) return;
+  grain = std::max(grain, size_t{1});
+  const auto chunks = (last - first + grain - 1) / grain;
+
+  struct state {
+    atomic<size_t> next{0};
+    atomic<size_t> done{0};
+    mutex error_mutex{};
+    exception_ptr error{};
+  };
+  const auto s = make_shared<state>();
+
+  const auto work = [s, first, last, grain, chunks, &f] {
+    for (auto c = s->next++; c < chunks; c = s->next++) {
+      const auto begin = first + c * grain;
+      const auto end = std::min(begin + grain, last);
+      try {
+        for (auto i = begin; i < end; ++i) f(i);
+      } catch (...) {
+        scoped_lock lock{s->error_mutex};
+        if (!s->error) s->error = current_exception();
+      }
+      if (++s->done == chunks) s->done.notify_all();
+    }
+  };
+
+  const auto helpers = std::min(pool.size(), chunks - 1);
+  for (size_t i = 0; i < helpers; ++i) pool.async(work);
+  work();
+
+  for (auto d = s->done.load(); d < chunks; d = s->done.load())
+    s->done.wait(d);
+  if (s->error) rethrow_exception(s->error);
+}
+
+// Sort chunks of the range in parallel and merge them pairwise
+// in parallel rounds. Small ranges are sorted sequentially.
+template <random_access_iterator I, typename C = ranges::less>
+void parallel_sort(I first,
+                   I last,
+                   C comp = {},
+                   thread_pool& pool = default_thread_pool()) {
+  constexpr size_t min_chunk_size = size_t{1} << 14;
+  const size_t n = last - first;
+  const auto chunks =
+      std::min(pool.size() + 1, std::max(n / min_chunk_size, size_t{1}));
+  if (chunks == 1) {
+    sort(first, last, comp);
+    return;
+  }
+
+  const auto bound = [&](size_t c) {
+    return first + std::min(c, chunks) * n / chunks;
+  };
+  parallel_for(0, chunks,
+               [&](size_t c) { sort(bound(c), bound(c + 1), comp); }, 1, pool);
+  for (size_t width = 1; width < chunks; width *= 2) {
+    parallel_for(
+        0, (chunks + 2 * width - 1) / (2 * width),
+        [&](size_t k) {
+          const auto c = 2 * width * k;
+          if (c + width >= chunks) return;
+          inplace_merge(bound(c), bound(c + width), bound(c + 2 * width), comp);
+        },
+        1, pool);
+  }
+}
+
+}  // namespace viewer
@@ -0,0 +1,312 @@
+#pragma once
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <tuple>
+//
+#include <libviewer/utility.hpp>
+//
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace viewer {
+
+// Incremental 64-bit hash to identify data by its content.
+// It is fast and well distributed but not cryptographically secure.
+struct content_hasher {
+  static constexpr auto mix(uint64 x) noexcept -> uint64 {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  void add(uint64 x) noexcept {
+    state = rotl(state ^ mix(x), 27) * 0x9e3779b97f4a7c15;
+  }
+
+  auto value() const noexcept -> uint64 { return mix(state); }
+
+  uint64 state = 0xcbf29ce484222325;
+};
+
+// Read-only memory mapping of a whole file.
+// An invalid mapping is returned if the file cannot be mapped.
+class mapped_file {
+ public:
+  mapped_file() = default;
+
+  explicit mapped_file(const filesystem::path& path) {
+    const auto handle = ::open(path.c_str(), O_RDONLY);
+    if (handle < 0) return;
+    struct stat info {};
+    if ((fstat(handle, &info) == 0) && (info.st_size > 0)) {
+      const auto p =
+          mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+      if (p != MAP_FAILED) {
+        ptr = static_cast<const byte*>(p);
+        bytes = info.st_size;
+      }
+    }
+    ::close(handle);
+  }
+
+  ~mapped_file() noexcept {
+    if (ptr) munmap(const_cast<byte*>(ptr), bytes);
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  mapped_file(mapped_file&& x) noexcept
+      : ptr{exchange(x.ptr, nullptr)}, bytes{exchange(x.bytes, 0)} {}
+  mapped_file& operator=(mapped_file&& x) noexcept {
+    swap(ptr, x.ptr);
+    swap(bytes, x.bytes);
+    return *this;
+  }
+
+  explicit operator bool() const noexcept { return ptr; }
+  auto data() const noexcept { return ptr; }
+  auto size() const noexcept { return bytes; }
+
+ private:
+  const byte* ptr = nullptr;
+  size_t bytes = 0;
+};
+
+// Binary files of precomputed mesh topology named by the content hash
+// of the mesh. They store the half-edges, sorted one-rings, face neighbors,
+// topology diagnostics and boundary segments as raw arrays
+// behind a header. Loading maps the file and copies the arrays,
+// which is much faster than recomputing them for large meshes.
+// Files are written to a temporary file first and renamed afterwards,
+// so concurrent viewers never read partially written files.
+// The cache is optional. Hence, failures are reported
+// by return values and never by exceptions.
+struct topology_cache {
+  static constexpr uint64 magic = 0x79676f6c6f706f74;  // "topology"
+  static constexpr uint32 version = 1;
+  static constexpr size_t array_count = 10;
+  static constexpr size_t alignment = 8;
+
+  struct header {
+    uint64 magic;
+    uint32 version;
+    uint32 index_size;
+    uint64 hash;
+    uint64 vertices;
+    uint64 faces;
+    // Size in bytes of every array
+    uint64 sizes[array_count];
+  };
+
+  bool enabled() const noexcept { return !directory.empty(); }
+
+  // Cache directory of the current user following the XDG base directories.
+  // A shared directory like the temporary one would let other users
+  // plant files under the predictable names. Without a home directory,
+  // an empty path is returned which disables the cache.
+  static auto user_directory() -> filesystem::path {
+    if (const auto cache = getenv("XDG_CACHE_HOME"); cache && *cache)
+      return filesystem::path{cache} / "libviewer" / "topology";
+    if (const auto home = getenv("HOME"); home && *home)
+      return filesystem::path{home} / ".cache" / "libviewer" / "topology";
+    return {};
+  }
+
+  auto path(uint64 hash) const -> filesystem::path {
+    stringstream name{};
+    name << hex << setw(16) << setfill('0') << hash << ".topology";
+    return directory / name.str();
+  }
+
+  // Cached arrays with the names of the mesh members
+  // which are validated before they replace those of the mesh.
+  template <typename I>
+  struct topology {
+    vector<I> twins{};
+    vector<I> outgoing_offset{};
+    vector<I> outgoing{};
+    vector<I> neighbor_offset{};
+    vector<I> neighbors{};
+    vector<array<I, 3>> face_neighbors{};
+    struct {
+      vector<I> boundary_vertices{};
+      vector<I> non_manifold_vertices{};
+      vector<I> isolated_vertices{};
+    } diagnostics{};
+  };
+
+  // Every cached array in the order of the file.
+  static auto arrays(auto& mesh, auto& boundary) {
+    return tie(mesh.twins, mesh.outgoing_offset, mesh.outgoing,
+               mesh.neighbor_offset, mesh.neighbors, mesh.face_neighbors,
+               mesh.diagnostics.boundary_vertices,
+               mesh.diagnostics.non_manifold_vertices,
+               mesh.diagnostics.isolated_vertices, boundary);
+  }
+
+  static void for_each_array(auto& mesh, auto& boundary, auto&& f) {
+    apply([&](auto&... v) { (f(v), ...); }, arrays(mesh, boundary));
+  }
+
+  // Whether 'size' bytes starting at 'offset' lie inside a file
+  // of 'file_size' bytes. Sizes read from files cannot wrap around.
+  static constexpr bool fits(size_t offset,
+                             uint64 size,
+                             size_t file_size) noexcept {
+    return (offset <= file_size) && (size <= file_size - offset);
+  }
+
+  // Loaded arrays have to match the sizes of the mesh and all indices
+  // have to be in range. Twins have to be symmetric and outgoing
+  // half-edges have to start at their vertex. So, no traversal
+  // of the topology can leave its arrays or loop forever.
+  template <typename I>
+  static bool consistent(const topology<I>& t, const auto& mesh) {
+    constexpr I invalid = -1;
+    const size_t n = mesh.vertices.size();
+    const size_t f = mesh.faces.size();
+    const size_t half_edges = 3 * f;
+    const auto rows = [n](const vector<I>& offset, const vector<I>& values) {
+      if ((offset.size() != n + 1) || (offset[0] != 0) ||
+          (offset[n] != values.size()))
+        return false;
+      for (size_t v = 0; v < n; ++v)
+        if (offset[v] > offset[v + 1]) return false;
+      return true;
+    };
+    const auto below = [](const vector<I>& values, size_t bound) {
+      return ranges::all_of(values, [bound](I x) { return x < bound; });
+    };
+
+    if ((t.twins.size() != half_edges) || (t.outgoing.size() != half_edges) ||
+        (t.face_neighbors.size() != f) ||
+        !rows(t.outgoing_offset, t.outgoing) ||
+        !rows(t.neighbor_offset, t.neighbors) || !below(t.neighbors, n) ||
+        !below(t.diagnostics.boundary_vertices, n) ||
+        !below(t.diagnostics.non_manifold_vertices, n) ||
+        !below(t.diagnostics.isolated_vertices, n))
+      return false;
+    for (size_t h = 0; h < half_edges; ++h) {
+      const auto x = t.twins[h];
+      if ((x != invalid) && ((x >= half_edges) || (t.twins[x] != h)))
+        return false;
+    }
+    for (size_t v = 0; v < n; ++v) {
+      for (auto i = t.outgoing_offset[v]; i < t.outgoing_offset[v + 1]; ++i) {
+        const auto h = t.outgoing[i];
+        if ((h >= half_edges) || (mesh.faces[h / 3][h % 3] != v)) return false;
+      }
+    }
+    for (const auto& neighbors : t.face_neighbors)
+      for (auto g : neighbors)
+        if ((g != invalid) && (g >= f)) return false;
+    return true;
+  }
+
+  // Returns whether the topology of 'mesh' and its boundary segments
+  // have been read from the cache. Otherwise, both stay unchanged.
+  // Files are not trusted. Arrays are read into temporaries
+  // and only used if their sizes and indices are consistent.
+  bool load(uint64 hash, auto& mesh, vector<vec3>& boundary) const {
+    if (!enabled()) return false;
+    const mapped_file file{path(hash)};
+    if (!file || (file.size() < sizeof(header))) return false;
+
+    using index_type = typename decay_t<decltype(mesh)>::index_type;
+    header h{};
+    memcpy(&h, file.data(), sizeof(header));
+    if ((h.magic != magic) || (h.version != version) ||
+        (h.index_size != sizeof(index_type)) || (h.hash != hash) ||
+        (h.vertices != mesh.vertices.size()) || (h.faces != mesh.faces.size()))
+      return false;
+
+    topology<index_type> t{};
+    vector<vec3> b{};
+    size_t offset = aligned(sizeof(header));
+    size_t i = 0;
+    bool valid = true;
+    for_each_array(t, b, [&](auto& v) {
+      using value_type = typename decay_t<decltype(v)>::value_type;
+      const auto size = h.sizes[i++];
+      if (!valid || !fits(offset, size, file.size()) ||
+          (size % sizeof(value_type) != 0)) {
+        valid = false;
+        return;
+      }
+      v.resize(size / sizeof(value_type));
+      memcpy(v.data(), file.data() + offset, size);
+      offset = aligned(offset + size);
+    });
+    if (!valid || !consistent(t, mesh)) return false;
+
+    auto target = arrays(mesh, boundary);
+    auto source = arrays(t, b);
+    [&]<size_t... k>(index_sequence<k...>) {
+      ((get<k>(target) = move(get<k>(source))), ...);
+    }(make_index_sequence<array_count>{});
+    return true;
+  }
+
+  // Returns whether the file has been written successfully.
+  bool store(uint64 hash,
+             const auto& mesh,
+             const vector<vec3>& boundary) const noexcept {
+    if (!enabled()) return false;
+    using index_type = typename decay_t<decltype(mesh)>::index_type;
+    try {
+      if (filesystem::create_directories(directory))
+        filesystem::permissions(directory, filesystem::perms::owner_all);
+      const auto file_path = path(hash);
+      auto temporary = file_path;
+      temporary += "." + to_string(getpid()) + "." +
+                   to_string(std::hash<thread::id>{}(this_thread::get_id()));
+
+      header h{};
+      h.magic = magic;
+      h.version = version;
+      h.index_size = sizeof(index_type);
+      h.hash = hash;
+      h.vertices = mesh.vertices.size();
+      h.faces = mesh.faces.size();
+      size_t i = 0;
+      for_each_array(mesh, boundary, [&](const auto& v) {
+        h.sizes[i++] = v.size() * sizeof(v[0]);
+      });
+
+      {
+        ofstream file{temporary, ios::binary};
+        const char padding[alignment]{};
+        const auto write = [&](const void* data, size_t size) {
+          file.write(static_cast<const char*>(data), size);
+          file.write(padding, aligned(size) - size);
+        };
+        write(&h, sizeof(header));
+        for_each_array(mesh, boundary, [&](const auto& v) {
+          write(v.data(), v.size() * sizeof(v[0]));
+        });
+        if (!file) {
+          file.close();
+          filesystem::remove(temporary);
+          return false;
+        }
+      }
+      filesystem::rename(temporary, file_path);
+      return true;
+    } catch (...) {
+      return false;
+    }
+  }
+
+  static constexpr auto aligned(size_t offset) noexcept -> size_t {
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+
+  // Caching is disabled for an empty directory.
+  filesystem::path directory{};
+};
+
+}  // namespace viewer
@@ -4,12 +4,14 @@
 #include <bit>
 #include <chrono>
 #include <cmath>
+#include <concepts>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <numbers>
+#include <span>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
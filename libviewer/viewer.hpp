@@ -1,6 +1,8 @@
 #pragma once
 #include <libviewer/async_cio.hpp>
 #include <libviewer/dynamic_function.hpp>
+#include <libviewer/intersection_batch.hpp>
+#include <libviewer/pick_buffer.hpp>
 #include <libviewer/scene.hpp>
 #include <libviewer/socket.hpp>
 #include <libviewer/utility.hpp>
@@ -44,17 +46,44 @@ class viewer {
 
   void interpret_command(const string& line);
 
+  auto primary_ray(float x, float y) const noexcept -> ray;
+  auto intersect(const vector<vec2>& pixels) const -> intersection_batch;
+  auto pick(float x, float y) const -> struct scene::intersection;
+  void set_pick_buffer(bool enable);
+  void set_topology_cache(bool enable);
+  void set_packed_vertices(bool enable);
+  void set_soa_vertices(bool enable);
   void select_face(float x, float y);
   void select_vertex(float x, float y);
+  void commit_vertex_selections(bool wait = false);
+  void add_curve_point(const ray& r, const struct scene::intersection& p);
+  void check_intersection();
+  void check_vertex_tree();
+  void report_topology();
+  void report_vertex_cache(int cache_size);
+  void report_lods();
+  void benchmark_cluster_culling(int views);
+  void benchmark_vertex_layout(int runs);
+  void benchmark_shortest_paths(int max_vertices);
+  void probe(int columns, int rows);
+  void set_intersection_kernel(const string& name);
+  void set_path_search(const string& name);
+  void benchmark_path_search(int pairs, int hops);
+  void compute_landmarks(int count);
 
   void preprocess_curve();
   void preprocess_face_curve();
+  void preprocess_geodesic_curve();
+  void straighten_curve();
   void check_curve_consistency();
   void compute_curve_curvature();
   void smooth_initial_curve();
   void smooth_vertex_curve();
 
  private:
+  // Show points on the surface of the mesh as curve.
+  void set_surface_curve(const mesh& m, const vector<vec3>& points);
+
   bool running_ = false;
   int screen_width, screen_height;
   time_type time = clock::now();
@@ -81,6 +110,15 @@ class viewer {
   uniform_buffer device_uniforms{};
 
   struct scene scene;
+  // File of the loaded model next to which precomputed data is stored
+  filesystem::path model_path{};
+  // Optional CPU rasterization of visible faces which is
+  // updated together with the view and used for selections.
+  bool use_pick_buffer = false;
+  class pick_buffer pick_buffer{};
+  // Reorder faces and vertices of loaded meshes for rendering.
+  bool optimize_vertex_cache = false;
+
   mesh selection{};
   points point_selection{};
 
@@ -91,16 +129,25 @@ class viewer {
     vec3 position;
   };
   vector<curve_point> curve_points{};
+  // Search for the paths between consecutive curve points
+  path_search curve_path_search = path_search::astar;
+
+  // Vertex selections are intersected asynchronously.
+  // Rays of the current frame are gathered and started as one batch.
+  // Finished results are appended to the curve points in order.
+  vector<ray> vertex_selection_rays{};
+  deque<intersection_batch> vertex_selections{};
+  size_t committed_vertex_selections = 0;
 
   struct mesh_curve {
     size_t mesh_id;
-    vector<size_t> vertices{};
+    vector<mesh::index_type> vertices{};
   };
   mesh_curve curve{};
 
   struct mesh_face_curve {
     size_t mesh_id;
-    vector<size_t> faces{};
+    vector<mesh::index_type> faces{};
   };
   mesh_face_curve face_curve{};
 
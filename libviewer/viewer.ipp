@@ -1,5 +1,7 @@
 #include <libviewer/viewer.hpp>
 //
+#include <random>
+//
 #include <libviewer/loader.hpp>
 //
 #include <stb_image.h>
@@ -46,12 +48,54 @@ viewer::viewer(int w, int h) : screen_width(w), screen_height(h) {
   calls["load_model"] =
       s.create([this](string path) { load_model(path.c_str()); });
 
+  calls["check_intersection"] = s.create([this] { check_intersection(); });
+  calls["check_vertex_tree"] = s.create([this] { check_vertex_tree(); });
+  calls["report_topology"] = s.create([this] { report_topology(); });
+  calls["probe"] =
+      s.create([this](int columns, int rows) { probe(columns, rows); });
+  calls["intersection_kernel"] =
+      s.create([this](string name) { set_intersection_kernel(name); });
+  calls["path_search"] =
+      s.create([this](string name) { set_path_search(name); });
+  calls["benchmark_path_search"] = s.create(
+      [this](int pairs, int hops) { benchmark_path_search(pairs, hops); });
+  calls["landmarks"] =
+      s.create([this](int count) { compute_landmarks(count); });
+  calls["pick_buffer"] =
+      s.create([this](bool enable) { set_pick_buffer(enable); });
+  calls["topology_cache"] =
+      s.create([this](bool enable) { set_topology_cache(enable); });
+  set_topology_cache(true);
+  calls["optimize_vertex_cache"] = s.create(
+      [this](bool enable) { optimize_vertex_cache = enable; });
+  calls["report_vertex_cache"] =
+      s.create([this](int cache_size) { report_vertex_cache(cache_size); });
+  calls["benchmark_cluster_culling"] =
+      s.create([this](int views) { benchmark_cluster_culling(views); });
+  calls["packed_vertices"] =
+      s.create([this](bool enable) { set_packed_vertices(enable); });
+  calls["soa_vertices"] =
+      s.create([this](bool enable) { set_soa_vertices(enable); });
+  calls["lod_pixel_error"] =
+      s.create([this](float pixels) { scene.lod_pixel_error = pixels; });
+  calls["report_lods"] = s.create([this] { report_lods(); });
+  calls["benchmark_vertex_layout"] =
+      s.create([this](int runs) { benchmark_vertex_layout(runs); });
+  calls["benchmark_shortest_paths"] = s.create(
+      [this](int max_vertices) { benchmark_shortest_paths(max_vertices); });
+  calls["geodesic_curve"] =
+      s.create([this] { preprocess_geodesic_curve(); });
+  calls["straighten_curve"] = s.create([this] { straighten_curve(); });
+
   calls["help"] = s.create([this] {
     for (const auto& [name, _] : calls) cout << name << endl;
   });
 }
 
-viewer::~viewer() {}
+viewer::~viewer() {
+  // Running intersections still reference the scene.
+  for (const auto& batch : vertex_selections) batch.get();
+}
 
 void viewer::resize() {
   glViewport(0, 0, screen_width, screen_height);
@@ -84,9 +128,19 @@ void viewer::interpret_command(const string& line) {
 void viewer::update() {
   if (view_should_update) {
     update_view();
+    if (use_pick_buffer) pick_buffer.rasterize(scene, cam);
     view_should_update = false;
   }
 
+  if (const auto time = scene.commit_lods(); time >= 0.0f)
+    cout << "levels of detail = " << time << " s" << endl;
+
+  commit_vertex_selections();
+  if (!vertex_selection_rays.empty()) {
+    vertex_selections.emplace_back(scene, move(vertex_selection_rays));
+    vertex_selection_rays.clear();
+  }
+
   if (auto connection = server.accept()) {
     string line{};
     while ((line = connection.read()).empty()) {
@@ -106,7 +160,7 @@ void viewer::render() {
   // Clear the screen.
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glDepthFunc(GL_LESS);
-  scene.render(shader);
+  scene.render(shader, cam);
 
   curve_shader.bind();
   scene.render_boundaries();
@@ -263,8 +317,18 @@ void viewer::fit_view() {
 }
 
 void viewer::load_model(czstring file_path) {
+  // Pending selections refer to the old scene and must not see it change.
+  for (const auto& batch : vertex_selections) batch.get();
+  vertex_selections.clear();
+  vertex_selection_rays.clear();
+  committed_vertex_selections = 0;
+  // Search workspaces of all threads are sized for the previous model.
+  release_search_workspaces<mesh::index_type>();
+
   loader l;
+  l.optimize_vertex_cache = optimize_vertex_cache;
   l.load(file_path, scene);
+  model_path = file_path;
 
   // for (size_t id = 0; auto& mesh : scene.meshes) {
   //   cout << "Mesh " << id << ":\n"
@@ -293,13 +357,49 @@ void viewer::load_model(czstring file_path) {
   // }
 
   fit_view();
-  scene.update();
+  const auto timings = scene.update();
   view_should_update = true;
 
   // cout << "edges = " << scene.meshes[0].edges.size() << endl;
 
   cout << "vertices = " << scene.meshes[0].vertices.size() << endl
        << "faces = " << scene.meshes[0].faces.size() << endl;
+
+  cout << "Scene Update:\n"
+       << "  textures = " << timings.textures << " s\n"
+       << "  uploads = " << timings.uploads << " s\n"
+       << "  topology = " << timings.topology << " s\n"
+       << "  boundaries = " << timings.boundaries << " s\n"
+       << "  clusters = " << timings.clusters << " s\n"
+       << "  dual graph = " << timings.dual_graph << " s\n"
+       << "  bvh = " << timings.bvh << " s\n"
+       << "  vertex tree = " << timings.vertex_tree << " s\n"
+       << "  total = " << timings.total << " s\n"
+       << "  cached topologies = " << timings.cached_topologies << endl;
+
+  // Landmarks are optional and only used if they have been stored before.
+  if (const auto count = landmark_file::load(model_path, scene.meshes))
+    cout << "landmarks loaded for " << count << " meshes" << endl;
+
+  for (size_t id = 0; const auto& mesh : scene.meshes) {
+    const auto& d = mesh.diagnostics;
+    if (!d.non_manifold_vertices.empty() || !d.isolated_vertices.empty())
+      cout << "mesh " << id << ": non-manifold vertices = "
+           << d.non_manifold_vertices.size()
+           << ", isolated vertices = " << d.isolated_vertices.size()
+           << ", boundary vertices = " << d.boundary_vertices.size() << endl;
+    ++id;
+  }
+
+  size_t topology_bytes = 0;
+  size_t wide_topology_bytes = 0;
+  for (const auto& mesh : scene.meshes) {
+    topology_bytes += mesh.topology_memory();
+    wide_topology_bytes += mesh.topology_memory(sizeof(size_t));
+  }
+  cout << "topology memory = " << topology_bytes / float(1 << 20) << " MiB ("
+       << wide_topology_bytes / float(1 << 20)
+       << " MiB with 64-bit indices)" << endl;
 }
 
 void viewer::load_shader(czstring path) {
@@ -346,7 +446,7 @@ void viewer::load_shader(czstring path) {
 
   // shader = shader_program{vs, fs};
 
-  shader = shader_from_file(path);
+  shader = shader_from_file(path, splice_packed_vertex_shader);
   view_should_update = true;
 
   const auto index = glGetUniformLocation(shader, "projection");
@@ -354,13 +454,71 @@ void viewer::load_shader(czstring path) {
   if (index == GL_INVALID_INDEX) cout << "index is invalid" << endl;
 }
 
+auto viewer::primary_ray(float x, float y) const noexcept -> ray {
+  return ::viewer::primary_ray(cam, x, y);
+}
+
+auto viewer::pick(float x, float y) const -> struct scene::intersection {
+  const auto r = primary_ray(x, y);
+  // The pick buffer is outdated until the next view update.
+  if (!use_pick_buffer || view_should_update || pick_buffer.empty())
+    return scene.intersect(r);
+
+  const auto texel = pick_buffer(int(std::floor(x)), int(std::floor(y)));
+  if (!texel) return {};
+  if (const auto p = scene.intersect(r, texel.mesh_id, texel.face_id)) return p;
+  // Faces are only sampled at pixel centers. So, positions near
+  // silhouettes may miss the face of their pixel.
+  return scene.intersect(r);
+}
+
+void viewer::set_pick_buffer(bool enable) {
+  use_pick_buffer = enable;
+  if (enable)
+    view_should_update = true;
+  else
+    pick_buffer.clear();
+}
+
+void viewer::set_packed_vertices(bool enable) {
+  const auto before = scene.vertex_memory();
+  const auto start = clock::now();
+  scene.set_packed_vertices(enable);
+  selection.set_packed_vertices(enable);
+  const auto end = clock::now();
+  cout << "vertex memory = " << before / float(1 << 20) << " MiB -> "
+       << scene.vertex_memory() / float(1 << 20) << " MiB\n"
+       << "upload time = " << duration<float>(end - start).count() << " s"
+       << endl;
+  if (!enable) return;
+  // Round trip of the quantization as restored by the shaders
+  float position_error = 0.0f;
+  float normal_error = 0.0f;
+  for (const auto& mesh : scene.meshes) {
+    const auto [p, n] = mesh.packing_error();
+    position_error = std::max(position_error, p);
+    normal_error = std::max(normal_error, n);
+  }
+  cout << "max position error = " << position_error << '\n'
+       << "max normal error = " << glm::degrees(normal_error) << " deg"
+       << endl;
+}
+
+void viewer::set_soa_vertices(bool enable) {
+  const auto start = clock::now();
+  scene.set_soa_vertices(enable);
+  selection.set_soa_vertices(enable);
+  cout << "upload time = " << duration<float>(clock::now() - start).count()
+       << " s" << endl;
+}
+
+void viewer::set_topology_cache(bool enable) {
+  scene.topology_cache.directory =
+      enable ? topology_cache::user_directory() : filesystem::path{};
+}
+
 void viewer::select_face(float x, float y) {
-  const auto direction = normalize(
-      cam.direction() +
-      cam.pixel_size() * ((x - 0.5f * cam.screen_width()) * cam.right() +
-                          (0.5f * cam.screen_height() - y) * cam.up()));
-  ray r{cam.position(), direction};
-  const auto p = scene.intersect(r);
+  const auto p = pick(x, y);
 
   if (p) {
     const auto& m = scene.meshes[p.mesh_id];
@@ -382,39 +540,582 @@ void viewer::select_face(float x, float y) {
 }
 
 void viewer::select_vertex(float x, float y) {
-  const auto direction = normalize(
-      cam.direction() +
-      cam.pixel_size() * ((x - 0.5f * cam.screen_width()) * cam.right() +
-                          (0.5f * cam.screen_height() - y) * cam.up()));
-  ray r{cam.position(), direction};
-  const auto p = scene.intersect(r);
+  // With an up-to-date pick buffer, the selection is cheap enough
+  // to be done immediately. Pending selections have to come first.
+  if (use_pick_buffer && !view_should_update && !pick_buffer.empty()) {
+    commit_vertex_selections(true);
+    const auto p = pick(x, y);
+    if (!p) return;
+    add_curve_point(primary_ray(x, y), p);
+    point_selection.update();
+    return;
+  }
+  vertex_selection_rays.push_back(primary_ray(x, y));
+}
 
-  // cout << "x = " << x << '\n'
-  //      << "y = " << y << '\n'
-  //      << "mesh = " << p.mesh_id << '\n'
-  //      << "face = " << p.face_id << '\n'
-  //      << "u = " << p.u << '\n'
-  //      << "v = " << p.v << '\n'
-  //      << "t = " << p.t << '\n'
-  //      << endl;
+void viewer::add_curve_point(const ray& r,
+                             const struct scene::intersection& p) {
+  const auto position = r.origin + p.t * r.direction;
+  curve_points.push_back({p.mesh_id, p.face_id, p.u, p.v, position});
+  point_selection.vertices.push_back({position});
+}
 
-  if (!p) return;
+void viewer::commit_vertex_selections(bool wait) {
+  if (wait && !vertex_selection_rays.empty()) {
+    vertex_selections.emplace_back(scene, move(vertex_selection_rays));
+    vertex_selection_rays.clear();
+  }
 
-  const auto& m = scene.meshes[p.mesh_id];
-  const auto& f = m.faces[p.face_id];
-  const auto& v = m.vertices;
+  bool changed = false;
+  while (!vertex_selections.empty()) {
+    const auto& batch = vertex_selections.front();
+    auto& i = committed_vertex_selections;
+    for (; i < batch.size(); ++i) {
+      if (!wait && !batch.available(i)) break;
+      const auto& p = batch[i];
+      if (!p) continue;
+      add_curve_point(batch.ray(i), p);
+      changed = true;
+    }
+    if (i < batch.size()) break;
+    vertex_selections.pop_front();
+    i = 0;
+  }
+  if (changed) point_selection.update();
+}
 
-  // const size_t index = (p.u > p.v) ? ((p.u > (1 - p.u - p.v)) ? (1) : (0))
-  //                                  : ((p.v > (1 - p.u - p.v)) ? (2) : (0));
+auto viewer::intersect(const vector<vec2>& pixels) const -> intersection_batch {
+  vector<ray> rays(pixels.size());
+  for (size_t i = 0; i < pixels.size(); ++i)
+    rays[i] = primary_ray(pixels[i].x, pixels[i].y);
+  return {scene, move(rays)};
+}
 
-  const auto position = r.origin + p.t * r.direction;
+void viewer::check_intersection() {
+  // Shoot rays through a regular grid of pixels and compare
+  // the BVH traversal of single rays and of ray packets
+  // with the brute-force intersection of all faces.
+  constexpr int samples = 64;
+  vector<ray> rays{};
+  rays.reserve(samples * samples);
+  for (int i = 0; i < samples; ++i)
+    for (int j = 0; j < samples; ++j)
+      rays.push_back(primary_ray((j + 0.5f) * cam.screen_width() / samples,
+                                 (i + 0.5f) * cam.screen_height() / samples));
+
+  vector<struct scene::intersection> fast(rays.size());
+  vector<struct scene::intersection> packets(rays.size());
+  vector<struct scene::intersection> exact(rays.size());
+
+  const auto start = clock::now();
+  for (size_t i = 0; i < rays.size(); ++i) fast[i] = scene.intersect(rays[i]);
+  const auto packets_start = clock::now();
+  scene.intersect(rays, packets);
+  const auto mid = clock::now();
+  for (size_t i = 0; i < rays.size(); ++i)
+    exact[i] = scene.intersect_brute_force(rays[i]);
+  const auto end = clock::now();
+
+  // Rays through shared edges may hit different faces at the same distance.
+  const auto mismatch = [&](const auto& x, const auto& y) {
+    return (bool(x) != bool(y)) || (y && (abs(x.t - y.t) > 1e-5f * y.t));
+  };
+  size_t hits = 0;
+  size_t mismatches = 0;
+  size_t packet_mismatches = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    if (exact[i]) ++hits;
+    if (mismatch(fast[i], exact[i])) ++mismatches;
+    if (mismatch(packets[i], exact[i])) ++packet_mismatches;
+  }
 
-  curve_points.push_back({p.mesh_id, p.face_id, p.u, p.v, position});
+  cout << "Intersection Check:\n"
+       << "  kernel = "
+       << intersection_kernel_name(active_intersection_kernel) << '\n'
+       << "  rays = " << rays.size() << '\n'
+       << "  hits = " << hits << '\n'
+       << "  mismatches = " << mismatches << '\n'
+       << "  packet mismatches = " << packet_mismatches << '\n'
+       << "  bvh time = " << duration<float>(packets_start - start).count()
+       << " s\n"
+       << "  packet time = " << duration<float>(mid - packets_start).count()
+       << " s\n"
+       << "  brute-force time = " << duration<float>(end - mid).count()
+       << " s" << endl;
+}
 
-  point_selection.vertices.push_back({position});
-  point_selection.update();
+void viewer::check_vertex_tree() {
+  // Compare nearest-vertex queries on a regular grid inside
+  // the bounding box of every mesh with a linear search.
+  constexpr int samples = 16;
+  size_t queries = 0;
+  size_t mismatches = 0;
+  duration<float> tree_time{};
+  duration<float> linear_time{};
+
+  for (const auto& m : scene.meshes) {
+    if (m.vertices.empty()) continue;
+    const auto box = m.bounds();
+    vector<vec3> points{};
+    points.reserve(samples * samples * samples);
+    for (int i = 0; i < samples; ++i)
+      for (int j = 0; j < samples; ++j)
+        for (int k = 0; k < samples; ++k)
+          points.push_back(box.min + vec3{i + 0.5f, j + 0.5f, k + 0.5f} /
+                                         float(samples) * box.size());
+
+    vector<size_t> fast(points.size());
+    const auto start = clock::now();
+    for (size_t i = 0; i < points.size(); ++i)
+      fast[i] = m.vertex_tree.nearest(points[i]);
+    const auto mid = clock::now();
+    for (size_t i = 0; i < points.size(); ++i) {
+      float d = INFINITY;
+      for (const auto& v : m.vertices)
+        d = std::min(d, distance2(points[i], v.position));
+      if (distance2(points[i], m.vertices[fast[i]].position) != d)
+        ++mismatches;
+    }
+    const auto end = clock::now();
+
+    queries += points.size();
+    tree_time += mid - start;
+    linear_time += end - mid;
+  }
+
+  cout << "Vertex Tree Check:\n"
+       << "  queries = " << queries << '\n'
+       << "  mismatches = " << mismatches << '\n'
+       << "  tree time per query = "
+       << 1e9f * tree_time.count() / std::max(queries, size_t{1}) << " ns\n"
+       << "  linear time per query = "
+       << 1e9f * linear_time.count() / std::max(queries, size_t{1}) << " ns"
+       << endl;
+}
+
+void viewer::report_topology() {
+  // Rebuild the edge map and the half-edges of every mesh
+  // and compare their build times, memory usage and edge queries.
+  for (size_t id = 0; auto& m : scene.meshes) {
+    const auto start = clock::now();
+    m.compute_edges();
+    const auto mid = clock::now();
+    m.compute_half_edges();
+    const auto end = clock::now();
+
+    // Nodes of 'unordered_map' store the value, a link and the hash code.
+    const auto map_bytes =
+        m.edges.size() * (sizeof(decltype(m.edges)::value_type) +
+                          sizeof(void*) + sizeof(size_t)) +
+        m.edges.bucket_count() * sizeof(void*);
+    const auto half_edge_bytes = (m.twins.capacity() +
+                                  m.outgoing_offset.capacity() +
+                                  m.outgoing.capacity()) *
+                                 sizeof(mesh::index_type);
+
+    // Query every edge of every face in both data structures.
+    size_t found = 0;
+    const auto map_query_start = clock::now();
+    for (const auto& f : m.faces)
+      for (int k = 0; k < 3; ++k) {
+        const size_t a = f[k], b = f[(k + 1) % 3];
+        found += m.edges.contains(pair{min(a, b), max(a, b)});
+      }
+    const auto map_query_end = clock::now();
+    for (const auto& f : m.faces)
+      for (int k = 0; k < 3; ++k) found += m.has_edge(f[k], f[(k + 1) % 3]);
+    const auto half_edge_query_end = clock::now();
+
+    cout << "Mesh " << id++ << " Topology:\n"
+         << "  vertices = " << m.vertices.size() << '\n'
+         << "  faces = " << m.faces.size() << '\n'
+         << "  edges = " << m.edges.size() << '\n'
+         << "  edge map build time = " << duration<float>(mid - start).count()
+         << " s\n"
+         << "  half-edge build time = " << duration<float>(end - mid).count()
+         << " s\n"
+         << "  edge map memory = " << map_bytes << " B\n"
+         << "  half-edge memory = " << half_edge_bytes << " B\n"
+         << "  adjacency memory = " << m.topology_memory() << " B ("
+         << m.topology_memory(sizeof(size_t)) << " B with 64-bit indices)\n"
+         << "  edge map query time = "
+         << duration<float>(map_query_end - map_query_start).count() << " s\n"
+         << "  half-edge query time = "
+         << duration<float>(half_edge_query_end - map_query_end).count()
+         << " s\n"
+         << "  found = " << found << endl;
+  }
+}
+
+void viewer::report_vertex_cache(int cache_size) {
+  for (size_t id = 0; const auto& m : scene.meshes) {
+    const auto s =
+        simulate_vertex_cache(m.faces, m.vertices.size(), cache_size);
+    cout << "Mesh " << id++ << " Vertex Cache:\n"
+         << "  ACMR = " << s.acmr << '\n'
+         << "  ATVR = " << s.atvr << endl;
+  }
+}
+
+void viewer::report_lods() {
+  // Levels of detail may still be built in the background.
+  if (const auto time = scene.commit_lods(true); time >= 0.0f)
+    cout << "levels of detail = " << time << " s" << endl;
+  for (size_t id = 0; const auto& m : scene.meshes) {
+    cout << "Mesh " << id++ << " Levels of Detail:\n"
+         << "  drawn = " << scene.lod(m, cam) << '\n'
+         << "  0: faces = " << m.faces.size() << ", error = 0\n";
+    for (size_t i = 0; const auto& l : m.lods)
+      cout << "  " << ++i << ": faces = " << l.count
+           << ", error = " << l.error << '\n';
+  }
+  cout << flush;
+}
+
+void viewer::benchmark_cluster_culling(int views) {
+  views = std::max(views, 1);
+  // Views are spread over the sphere around the origin
+  // at the current distance by a Fibonacci lattice.
+  size_t clusters = 0;
+  size_t frustum_culled = 0;
+  size_t cone_culled = 0;
+  size_t faces = 0;
+  size_t visible_faces = 0;
+  size_t backfacing_faces = 0;
+  float time = 0.0f;
+  const auto inverse_model_matrix = inverse(scene.model_matrix);
+  auto view = cam;
+  for (int i = 0; i < views; ++i) {
+    const auto z = 1.0f - (2.0f * i + 1.0f) / views;
+    const auto r = std::sqrt(1.0f - z * z);
+    const auto phi = i * pi * (3.0f - std::sqrt(5.0f));
+    const auto p =
+        r * std::cos(phi) * right + r * std::sin(phi) * front + z * up;
+    view.move(origin + radius * p).look_at(origin, up);
+    view.set_near_and_far(std::max(1e-3f * radius, radius - bounding_radius),
+                          radius + bounding_radius);
+
+    const frustum f{view.projection_matrix() * view.view_matrix() *
+                    scene.model_matrix};
+    const auto eye = vec3(inverse_model_matrix * vec4(view.position(), 1.0f));
+
+    const auto start = clock::now();
+    for (const auto& mesh : scene.meshes) {
+      mesh.for_each_cluster([&](const auto& c, auto) {
+        ++clusters;
+        if (f.outside(c.center, c.radius)) {
+          ++frustum_culled;
+          return;
+        }
+        if (backfacing(c, eye)) {
+          ++cone_culled;
+          return;
+        }
+        visible_faces += c.count;
+      });
+    }
+    time += duration<float>(clock::now() - start).count();
+
+    // Reference for the cone test given by culling single faces
+    for (const auto& mesh : scene.meshes) {
+      faces += mesh.faces.size();
+      for (size_t fid = 0; fid < mesh.faces.size(); ++fid) {
+        const auto& v = mesh.vertices[mesh.faces[fid][0]].position;
+        backfacing_faces += dot(mesh.face_area_normal(fid), v - eye) >= 0.0f;
+      }
+    }
+  }
+
+  if (clusters == 0) {
+    cout << "No clusters to cull. Load a model with faces first." << endl;
+    return;
+  }
 
-  // cout << "curve point count = " << curve_points.size() << endl;
+  const auto percent = [](size_t x, size_t n) { return 100.0f * x / n; };
+  cout << "Cluster Culling:\n"
+       << "  views = " << views << '\n'
+       << "  clusters = " << clusters / views << '\n'
+       << "  faces per cluster = " << float(faces) / clusters << '\n'
+       << "  frustum culled = " << percent(frustum_culled, clusters)
+       << " %\n"
+       << "  cone culled = " << percent(cone_culled, clusters) << " %\n"
+       << "  drawn faces = " << percent(visible_faces, faces) << " %\n"
+       << "  backfacing faces = " << percent(backfacing_faces, faces)
+       << " %\n"
+       << "  time per cluster = " << 1e9f * time / clusters << " ns" << endl;
+}
+
+void viewer::benchmark_vertex_layout(int runs) {
+  runs = std::max(runs, 1);
+  // Position-only work as done by fitting the view,
+  // building BVHs and path searches
+  const auto run = [runs](const auto& mesh) {
+    float checksum = 0.0f;
+    const auto start = clock::now();
+    for (int r = 0; r < runs; ++r) {
+      aabb box{};
+      for (const auto& v : mesh.vertices) box.extend(v.position);
+      checksum += box.size().x;
+      for (size_t fid = 0; fid < mesh.faces.size(); ++fid) {
+        const auto& f = mesh.faces[fid];
+        checksum += mesh.face_bounds(fid).min.x + mesh.distance(f[0], f[1]);
+      }
+    }
+    return pair{duration<float>(clock::now() - start).count() / runs,
+                checksum};
+  };
+
+  for (size_t id = 0; const auto& m : scene.meshes) {
+    basic_soa_mesh soa{};
+    soa.vertices = vertex_soa{m.vertices};
+    soa.faces = m.faces;
+    const auto [aos_time, aos_checksum] = run(m);
+    const auto [soa_time, soa_checksum] = run(soa);
+    cout << "Mesh " << id++ << " Vertex Layout:\n"
+         << "  AoS = " << 1e3f * aos_time << " ms\n"
+         << "  SoA = " << 1e3f * soa_time << " ms\n"
+         << "  speedup = " << aos_time / soa_time << '\n'
+         << "  consistent = " << boolalpha << (aos_checksum == soa_checksum)
+         << endl;
+  }
+}
+
+void viewer::benchmark_shortest_paths(int max_vertices) {
+  // Wavy square grid with 'n * n' vertices and its topology
+  const auto grid = [](size_t n) {
+    basic_mesh m{};
+    m.vertices.reserve(n * n);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        const auto x = float(j) / n;
+        const auto y = float(i) / n;
+        const auto z = 0.05f * std::sin(20.0f * x) * std::cos(20.0f * y);
+        m.vertices.push_back({{x, y, z}, {0, 0, 1}, {x, y}});
+      }
+    }
+    m.faces.reserve(2 * (n - 1) * (n - 1));
+    for (uint32 i = 0; i + 1 < n; ++i) {
+      for (uint32 j = 0; j + 1 < n; ++j) {
+        const auto v = uint32(i * n + j);
+        m.faces.push_back({v, v + 1, uint32(v + n + 1)});
+        m.faces.push_back({v, uint32(v + n + 1), uint32(v + n)});
+      }
+    }
+    m.compute_half_edges();
+    m.compute_neighbors();
+    return m;
+  };
+
+  // Previous queue of the fast search which rebuilds the heap
+  // in every step and pushes duplicates instead of decreasing keys
+  const auto rebuilt_heap_search = [](const basic_mesh& m, uint32 src,
+                                      uint32 dst) {
+    vector<bool> visited(m.vertices.size(), false);
+    vector<float> distances(m.vertices.size(), INFINITY);
+    distances[src] = 0;
+    vector<uint32> queue{src};
+    const auto order = [&](uint32 i, uint32 j) {
+      return distances[i] > distances[j];
+    };
+    do {
+      ranges::make_heap(queue, order);
+      ranges::pop_heap(queue, order);
+      const auto current = queue.back();
+      queue.pop_back();
+      visited[current] = true;
+      for (auto i = m.neighbor_offset[current];
+           i < m.neighbor_offset[current + 1]; ++i) {
+        const auto neighbor = m.neighbors[i];
+        if (visited[neighbor]) continue;
+        const auto d = m.distance(current, neighbor) + distances[current];
+        if (d >= distances[neighbor]) continue;
+        distances[neighbor] = d;
+        queue.push_back(neighbor);
+      }
+    } while (!queue.empty() && !visited[dst]);
+    return distances[dst];
+  };
+
+  // Searches are skipped for larger meshes if their time extrapolated
+  // by the observed growth per tenfold size exceeds ten seconds.
+  const auto affordable = [](float time, float growth) {
+    return time * growth < 10.0f;
+  };
+  float heap_time = 0.0f;
+  float rebuilt_time = 0.0f;
+  float quadratic_time = 0.0f;
+  const auto timed = [](auto&& f) {
+    const auto start = clock::now();
+    f();
+    return duration<float>(clock::now() - start).count();
+  };
+  const auto print = [](float time, bool done) {
+    if (done)
+      cout << setw(14) << 1e3f * time;
+    else
+      cout << setw(14) << "-";
+  };
+
+  cout << "Shortest Paths between opposite corners in ms:\n"
+       << setw(10) << "vertices" << setw(14) << "indexed heap" << setw(14)
+       << "rebuilt heap" << setw(14) << "O(V^2)" << endl;
+  for (size_t size = 10'000; size <= size_t(max_vertices); size *= 10) {
+    const auto n = size_t(std::sqrt(float(size)));
+    const auto m = grid(n);
+    const uint32 src = 0;
+    const uint32 dst = n * n - 1;
+
+    vector<uint32> path{};
+    heap_time = timed([&] { path = m.compute_shortest_path_fast(src, dst); });
+    const auto rebuilt = affordable(rebuilt_time, 30.0f);
+    if (rebuilt)
+      rebuilt_time = timed([&] { rebuilt_heap_search(m, src, dst); });
+    const auto quadratic = affordable(quadratic_time, 100.0f);
+    if (quadratic)
+      quadratic_time = timed([&] { m.compute_shortest_path(src, dst); });
+
+    cout << setw(10) << n * n;
+    print(heap_time, true);
+    print(rebuilt_time, rebuilt);
+    print(quadratic_time, quadratic);
+    cout << endl;
+  }
+}
+
+void viewer::probe(int columns, int rows) {
+  vector<vec2> pixels{};
+  pixels.reserve(columns * rows);
+  for (int i = 0; i < rows; ++i)
+    for (int j = 0; j < columns; ++j)
+      pixels.push_back({(j + 0.5f) * cam.screen_width() / columns,
+                        (i + 0.5f) * cam.screen_height() / rows});
+
+  const auto start = clock::now();
+  const auto batch = intersect(pixels);
+  const auto& results = batch.get();
+  const auto end = clock::now();
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& p = results[i];
+    if (!p) continue;
+    cout << pixels[i].x << ' ' << pixels[i].y << ' ' << p.mesh_id << ' '
+         << p.face_id << ' ' << p.u << ' ' << p.v << ' ' << p.t << '\n';
+  }
+  cout << "probe time = " << duration<float>(end - start).count() << " s"
+       << endl;
+}
+
+void viewer::set_intersection_kernel(const string& name) {
+  for (auto kernel : {intersection_kernel::scalar, intersection_kernel::sse,
+                      intersection_kernel::avx2}) {
+    if (name != intersection_kernel_name(kernel)) continue;
+    if (!available(kernel)) {
+      cout << "Intersection kernel '" << name
+           << "' is not supported on this CPU." << endl;
+      return;
+    }
+    active_intersection_kernel = kernel;
+    return;
+  }
+  cout << "Unknown intersection kernel '" << name << "'." << endl;
+}
+
+void viewer::set_path_search(const string& name) {
+  for (auto method : {path_search::dijkstra, path_search::astar,
+                      path_search::bidirectional, path_search::landmarks}) {
+    if (name != path_search_name(method)) continue;
+    curve_path_search = method;
+    return;
+  }
+  cout << "Unknown path search '" << name << "'." << endl;
+}
+
+void viewer::benchmark_path_search(int pairs, int hops) {
+  if (scene.meshes.empty()) return;
+  const auto& m = scene.meshes[0];
+  if (m.vertices.empty() || m.faces.empty()) return;
+
+  // Destinations are reached by random walks of the given number
+  // of hops like consecutive points of a curve.
+  mt19937 rng{0};
+  vector<pair<uint32, uint32>> vertex_pairs{};
+  vector<pair<uint32, uint32>> face_pairs{};
+  for (int i = 0; i < pairs; ++i) {
+    auto v = uint32(rng() % m.vertices.size());
+    auto f = uint32(rng() % m.faces.size());
+    const auto src = v;
+    const auto src_face = f;
+    for (int k = 0; k < hops; ++k) {
+      const auto first = m.neighbor_offset[v];
+      const auto count = m.neighbor_offset[v + 1] - first;
+      if (count) v = m.neighbors[first + rng() % count];
+      const auto g = m.face_neighbors[f][rng() % 3];
+      if (g != m.invalid_index) f = g;
+    }
+    vertex_pairs.emplace_back(src, v);
+    face_pairs.emplace_back(src_face, f);
+  }
+
+  cout << "Path Search for " << pairs << " pairs of " << hops << " hops:\n";
+  for (auto method : {path_search::dijkstra, path_search::astar,
+                      path_search::bidirectional, path_search::landmarks}) {
+    search_statistics vertex_statistics{};
+    search_statistics face_statistics{};
+    size_t vertex_length = 0;
+    size_t face_length = 0;
+    const auto start = clock::now();
+    for (auto [src, dst] : vertex_pairs)
+      vertex_length +=
+          m.compute_shortest_path(method, src, dst, &vertex_statistics).size();
+    const auto vertex_time = duration<float>(clock::now() - start).count();
+    for (auto [src, dst] : face_pairs)
+      face_length +=
+          m.compute_shortest_face_path(method, src, dst, &face_statistics)
+              .size();
+    const auto face_time =
+        duration<float>(clock::now() - start).count() - vertex_time;
+    cout << "  " << path_search_name(method) << ":\n"
+         << "    vertex expanded = " << vertex_statistics.expanded << '\n'
+         << "    vertex path length = " << vertex_length << '\n'
+         << "    vertex time = " << vertex_time << " s\n"
+         << "    face expanded = " << face_statistics.expanded << '\n'
+         << "    face path length = " << face_length << '\n'
+         << "    face time = " << face_time << " s\n";
+    if (method != path_search::landmarks) continue;
+    cout << "    vertex landmark bounds = " << vertex_statistics.landmark_bounds
+         << " / " << vertex_statistics.bounds << '\n'
+         << "    face landmark bounds = " << face_statistics.landmark_bounds
+         << " / " << face_statistics.bounds << '\n';
+  }
+  cout << flush;
+}
+
+// Landmarks are computed for all meshes in parallel and stored
+// next to the model. So, the next load of the model reads them.
+// No landmarks are used for a count of zero.
+void viewer::compute_landmarks(int count) {
+  if (model_path.empty() || (count < 0)) return;
+  const auto start = clock::now();
+  parallel_for(0, scene.meshes.size(),
+               [&](size_t i) { scene.meshes[i].compute_landmarks(count); });
+  const auto time = duration<float>(clock::now() - start).count();
+  const auto stored = landmark_file::store(model_path, scene.meshes);
+
+  size_t vertex_landmarks = 0;
+  size_t face_landmarks = 0;
+  size_t bytes = 0;
+  for (const auto& mesh : scene.meshes) {
+    vertex_landmarks += mesh.vertex_landmarks.size();
+    face_landmarks += mesh.face_landmarks.size();
+    bytes += mesh.vertex_landmarks.memory() + mesh.face_landmarks.memory();
+  }
+  cout << "Landmarks:\n"
+       << "  vertex landmarks = " << vertex_landmarks << '\n'
+       << "  face landmarks = " << face_landmarks << '\n'
+       << "  memory = " << bytes / float(1 << 20) << " MiB\n"
+       << "  time = " << time << " s\n"
+       << "  file = " << landmark_file::path(model_path)
+       << (stored ? "" : " (failed to write)") << endl;
 }
 
 void viewer::check_curve_consistency() {
@@ -437,7 +1138,7 @@ void viewer::check_curve_consistency() {
   for (size_t i = 1; i < vertices.size(); ++i) {
     auto a = vertices[i];
     auto b = vertices[i - 1];
-    if (mesh.edges.contains(pair(min(a, b), max(a, b)))) continue;
+    if (mesh.has_edge(a, b)) continue;
     cout << "Curve Consistency Check Failed: Curve contains adjacent point "
             "that are no neighbors."
          << endl;
@@ -447,7 +1148,7 @@ void viewer::check_curve_consistency() {
   for (size_t i = 2; i < vertices.size(); ++i) {
     auto a = vertices[i];
     auto b = vertices[i - 2];
-    if ((a != b) && (!mesh.edges.contains(pair(min(a, b), max(a, b)))))
+    if ((a != b) && (!mesh.has_edge(a, b)))
       continue;
     cout << "Curve Consistency Check Failed: Curve contains three adjacent "
             "point that are on the same triangle."
@@ -459,43 +1160,60 @@ void viewer::check_curve_consistency() {
 }
 
 void viewer::preprocess_curve() {
+  commit_vertex_selections(true);
   if (curve_points.empty()) return;
 
   curve.vertices.clear();
 
+  // Curve points are given in world space whereas
+  // the vertex trees of the meshes live in object space.
+  const auto inverse_model_matrix = inverse(scene.model_matrix);
+  const auto snap = [&](const curve_point& p) -> size_t {
+    return scene.meshes[p.mesh_id].vertex_tree.nearest(
+        vec3(inverse_model_matrix * vec4(p.position, 1.0f)));
+  };
+
   const auto& p = curve_points[0];
   const auto& m = scene.meshes[p.mesh_id];
-  const auto& f = m.faces[p.face_id];
-  const auto& v = m.vertices;
-  const auto index = voronoi_snap(
-      {v[f[0]].position, v[f[1]].position, v[f[2]].position}, p.position);
 
   curve.mesh_id = p.mesh_id;
-  curve.vertices.push_back(f[index]);
 
   size_t face_id = p.face_id;
   bool max_insert = false;
 
-  for (size_t i = 1; i < curve_points.size(); ++i) {
-    const auto& p = curve_points[i];
-
-    if (p.mesh_id != curve.mesh_id) break;
+  // Only the leading points on the same mesh form the curve.
+  size_t count = 1;
+  while ((count < curve_points.size()) &&
+         (curve_points[count].mesh_id == curve.mesh_id))
+    ++count;
+
+  // Snapped points are independent and so are the paths between them.
+  // Both are computed in parallel and stitched in order afterwards.
+  vector<mesh::index_type> snapped(count);
+  parallel_for(0, count, [&](size_t i) { snapped[i] = snap(curve_points[i]); });
+  vector<vector<mesh::index_type>> paths(count);
+  vector<search_statistics> segment_statistics(count);
+  parallel_for(1, count, [&](size_t i) {
+    const auto a = snapped[i - 1];
+    const auto b = snapped[i];
+    if (a == b) return;
+    paths[i] = m.compute_shortest_path(curve_path_search, a, b,
+                                       &segment_statistics[i]);
+  });
 
-    const auto& m = scene.meshes[p.mesh_id];
-    const auto& f = m.faces[p.face_id];
-    const auto& v = m.vertices;
-    const auto id = voronoi_snap(
-        {v[f[0]].position, v[f[1]].position, v[f[2]].position}, p.position);
-    size_t vid = f[id];
-
-    const auto a = curve.vertices.back();
-    if (vid != a) {
-      const auto path = m.compute_shortest_path_fast(a, vid);
-      // If there is no path then no connection exists.
-      if (path.empty()) break;
-      for (auto x : path) curve.vertices.push_back(x);
-    }
+  search_statistics statistics{};
+  curve.vertices.push_back(snapped[0]);
+  for (size_t i = 1; i < count; ++i) {
+    statistics.searches += segment_statistics[i].searches;
+    statistics.expanded += segment_statistics[i].expanded;
+    if (snapped[i] == snapped[i - 1]) continue;
+    // If there is no path then no connection exists.
+    if (paths[i].empty()) break;
+    for (auto x : paths[i]) curve.vertices.push_back(x);
   }
+  cout << "path search = " << path_search_name(curve_path_search)
+       << ", searches = " << statistics.searches
+       << ", expanded = " << statistics.expanded << endl;
 
   // Remove artifacts.
   // has to be done after path generation because start or end connection
@@ -519,7 +1237,7 @@ void viewer::preprocess_curve() {
         continue;
       }
       // At this point, a must be a neighbor of vid and b by construction.
-      if (m.edges.contains(pair{min(b, vid), max(b, vid)})) {
+      if (m.has_edge(b, vid)) {
         // All points lie on triangle. Remove middle point.
         --curve_size;
         --i;
@@ -687,7 +1405,95 @@ void viewer::preprocess_curve() {
   }
 }
 
+void viewer::preprocess_geodesic_curve() {
+  commit_vertex_selections(true);
+  if (curve_points.empty()) return;
+
+  const auto mesh_id = curve_points[0].mesh_id;
+  auto& m = scene.meshes[mesh_id];
+  if (m.geodesics.empty()) {
+    const auto start = clock::now();
+    if (!m.compute_heat_method()) {
+      cout << "Heat method factorization failed." << endl;
+      return;
+    }
+    cout << "heat method factorization = "
+         << duration<float>(clock::now() - start).count()
+         << " s, nonzeros = " << m.geodesics.factor_nonzeros() << endl;
+  }
+
+  size_t count = 1;
+  while ((count < curve_points.size()) &&
+         (curve_points[count].mesh_id == mesh_id))
+    ++count;
+
+  // Every segment is traced from its end down the distances
+  // to its start and reversed afterwards.
+  const auto inverse_model_matrix = inverse(scene.model_matrix);
+  vector<mesh::index_type> snapped(count);
+  parallel_for(0, count, [&](size_t i) {
+    snapped[i] = m.vertex_tree.nearest(
+        vec3(inverse_model_matrix * vec4(curve_points[i].position, 1.0f)));
+  });
+  const auto start = clock::now();
+  vector<vector<vec3>> segments(count);
+  parallel_for(1, count, [&](size_t i) {
+    if (snapped[i] == snapped[i - 1]) return;
+    const mesh::index_type source[] = {snapped[i - 1]};
+    segments[i] = m.trace_geodesic(m.geodesics.distances(source), snapped[i]);
+    ranges::reverse(segments[i]);
+  });
+  cout << "heat method queries = " << count - 1 << ", time = "
+       << duration<float>(clock::now() - start).count() << " s" << endl;
+
+  vector<vec3> points{m.position(snapped[0])};
+  for (size_t i = 1; i < count; ++i) {
+    // Points snapped to the same vertex give no segment.
+    if (segments[i].empty()) continue;
+    // A descent stuck in another local minimum misses the previous point.
+    // Then, the curve ends like for a failed path search.
+    if (segments[i].front() != m.position(snapped[i - 1])) {
+      cout << "Geodesic descent of segment " << i
+           << " ended in a local minimum. Curve stops there." << endl;
+      break;
+    }
+    points.insert(points.end(), segments[i].begin() + 1, segments[i].end());
+  }
+  set_surface_curve(m, points);
+}
+
+void viewer::straighten_curve() {
+  if (curve.vertices.size() < 2) return;
+  const auto& m = scene.meshes[curve.mesh_id];
+  straightening_statistics statistics{};
+  const auto start = clock::now();
+  const auto points = m.straighten_path(curve.vertices, &statistics);
+  const auto time = duration<float>(clock::now() - start).count();
+  if (points.empty()) {
+    cout << "Curve is not a connected vertex path and cannot be straightened."
+         << endl;
+    return;
+  }
+  cout << "Curve Straightening:\n"
+       << "  iterations = " << statistics.iterations << '\n'
+       << "  flips = " << statistics.flips << '\n'
+       << "  initial length = " << statistics.initial_length << '\n'
+       << "  length = " << statistics.length << '\n'
+       << "  time = " << time << " s" << endl;
+  set_surface_curve(m, points);
+}
+
+void viewer::set_surface_curve(const mesh& m, const vector<vec3>& points) {
+  point_selection.vertices.clear();
+  for (const auto& p : points) {
+    const auto& v = m.vertices[m.vertex_tree.nearest(p)];
+    point_selection.vertices.push_back({p, v.normal});
+  }
+  point_selection.update();
+}
+
 void viewer::preprocess_face_curve() {
+  commit_vertex_selections(true);
   if (curve_points.empty()) return;
 
   face_curve.faces.clear();
@@ -698,20 +1504,37 @@ void viewer::preprocess_face_curve() {
 
   const auto& m = scene.meshes[p.mesh_id];
 
-  for (size_t i = 1; i < curve_points.size(); ++i) {
-    const auto& p = curve_points[i];
-    if (p.mesh_id != face_curve.mesh_id) break;
-    const auto fid = p.face_id;
+  size_t count = 1;
+  while ((count < curve_points.size()) &&
+         (curve_points[count].mesh_id == face_curve.mesh_id))
+    ++count;
+
+  // Paths between consecutive faces are computed in parallel
+  // and stitched in order afterwards.
+  vector<vector<mesh::index_type>> paths(count);
+  vector<search_statistics> segment_statistics(count);
+  parallel_for(1, count, [&](size_t i) {
+    const auto a = curve_points[i - 1].face_id;
+    const auto b = curve_points[i].face_id;
+    if (a == b) return;
+    paths[i] = m.compute_shortest_face_path(curve_path_search, a, b,
+                                            &segment_statistics[i]);
+  });
 
-    const auto a = face_curve.faces.back();
-    if (fid == a) continue;
+  search_statistics statistics{};
+  for (size_t i = 1; i < count; ++i) {
+    statistics.searches += segment_statistics[i].searches;
+    statistics.expanded += segment_statistics[i].expanded;
+    if (curve_points[i].face_id == curve_points[i - 1].face_id) continue;
     // face_curve.faces.push_back(fid);
 
-    const auto path = m.compute_shortest_face_path_fast(a, fid);
     // If there is no path then no connection exists.
-    if (path.empty()) break;
-    for (auto x : path) face_curve.faces.push_back(x);
+    if (paths[i].empty()) break;
+    for (auto x : paths[i]) face_curve.faces.push_back(x);
   }
+  cout << "path search = " << path_search_name(curve_path_search)
+       << ", searches = " << statistics.searches
+       << ", expanded = " << statistics.expanded << endl;
 
   // Remove artifacts
   {
@@ -759,19 +1582,12 @@ void viewer::preprocess_face_curve() {
   for (size_t i = 1; i < face_curve.faces.size(); ++i) {
     const auto a = face_curve.faces[i - 1];
     const auto b = face_curve.faces[i];
-    size_t k = 0;
-    for (; k < 3; ++k)
-      if (m.face_neighbors[b][k] == a) break;
-    // size_t l = 0;
-    // for (; l < 3; ++l)
-    //   if (m.face_neighbors[a][l] == b) break;
-    // if (pair(min(m.faces[b][(k + 1) % 3], m.faces[b][(k + 2) % 3]),
-    //          max(m.faces[b][(k + 1) % 3], m.faces[b][(k + 2) % 3])) !=
-    //     pair(min(m.faces[a][(l + 1) % 3], m.faces[a][(l + 2) % 3]),
-    //          max(m.faces[a][(l + 1) % 3], m.faces[a][(l + 2) % 3])))
-    //   cout << "fucking error!!" << endl;
-    const auto vid1 = m.faces[b][(k + 1) % 3];
-    const auto vid2 = m.faces[b][(k + 2) % 3];
+    // The shared edge is taken in the orientation of the entered face.
+    // Consecutive faces of the curve share an edge by construction.
+    const auto e = m.dual_edge_index(b, a);
+    assert(e != m.invalid_index);
+    if (e == m.invalid_index) continue;
+    const auto [vid1, vid2] = m.dual_edge_vertices[e];
     const auto position =
         (m.vertices[vid1].position + m.vertices[vid2].position) / 2.0f;
     const auto normal =
@@ -1076,8 +1892,7 @@ void viewer::smooth_vertex_curve() {
       const auto vid2 = x.edge[1];
       const auto vid = vid1;
       //
-      assert(mesh.edges.contains(
-          pair(min(vid, prev.edge[0]), max(vid, prev.edge[0]))));
+      assert(mesh.has_edge(vid, prev.edge[0]));
       //
       //
       size_t split = mesh.neighbor_offset[vid + 1];
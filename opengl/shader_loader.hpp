@@ -4,8 +4,13 @@
 
 namespace opengl {
 
-inline auto shader_from_file(czstring file_path) -> shader_program {
+// 'preprocess' maps the source text of every stage before its compilation.
+inline auto shader_from_file(czstring file_path, auto&& preprocess)
+    -> shader_program {
   const auto path = filesystem::path(file_path);
+  const auto source = [&](const filesystem::path& p) -> string {
+    return preprocess(string_from_file(p.c_str()));
+  };
 
   if (!is_directory(path))
     throw runtime_error("Unsupported GLSL shader file structure in '"s +
@@ -15,21 +20,25 @@ inline auto shader_from_file(czstring file_path) -> shader_program {
   if (!is_regular_file(vs_path))
     throw runtime_error("Vertex shader file '" + vs_path.string() +
                         "' does not exist.");
-  const auto vs = vertex_shader_from_file(vs_path.c_str());
+  const vertex_shader vs{source(vs_path).c_str()};
 
   const auto fs_path = path / "fs.glsl";
   if (!is_regular_file(fs_path))
     throw runtime_error("Fragment shader file '" + fs_path.string() +
                         "' does not exist.");
-  const auto fs = fragment_shader_from_file(fs_path.c_str());
+  const fragment_shader fs{source(fs_path).c_str()};
 
   const auto gs_path = path / "gs.glsl";
   if (is_regular_file(gs_path)) {
-    const auto gs = geometry_shader_from_file(gs_path.c_str());
+    const geometry_shader gs{source(gs_path).c_str()};
     return shader_program{vs, gs, fs};
   }
 
   return shader_program{vs, fs};
 }
 
+inline auto shader_from_file(czstring file_path) -> shader_program {
+  return shader_from_file(file_path, [](string source) { return source; });
+}
+
 }  // namespace opengl
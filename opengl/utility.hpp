@@ -38,6 +38,14 @@ using glm::uvec2;
 using glm::uvec3;
 using glm::uvec4;
 
+using glm::i16vec2;
+using glm::i16vec3;
+using glm::i16vec4;
+
+using glm::u16vec2;
+using glm::u16vec3;
+using glm::u16vec4;
+
 using glm::mat2;
 using glm::mat3;
 using glm::mat4;
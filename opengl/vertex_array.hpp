@@ -3,6 +3,18 @@
 
 namespace opengl {
 
+// Integer attributes which shaders read as floats in [0, 1]
+// for unsigned and in [-1, 1] for signed types.
+template <typename T>
+struct normalized {
+  T value{};
+};
+
+// Two half-precision floats as packed by 'glm::packHalf2x16'.
+struct half2 {
+  uint32_t bits{};
+};
+
 namespace detail {
 
 template <typename T>
@@ -15,12 +27,26 @@ requires requires {
 struct attribute_pointer_traits<T> {
   static constexpr GLenum type = opengl::common_enum_value<T>;
   static constexpr GLint size = 1;
+  static constexpr GLboolean normalize = GL_FALSE;
 };
 // GLM Vector Types
 template <typename T, int N, glm::qualifier Q>
 struct attribute_pointer_traits<glm::vec<N, T, Q>> {
   static constexpr GLenum type = opengl::common_enum_value<T>;
   static constexpr GLint size = N;
+  static constexpr GLboolean normalize = GL_FALSE;
+};
+// Normalized Integer Types
+template <typename T>
+struct attribute_pointer_traits<normalized<T>> : attribute_pointer_traits<T> {
+  static constexpr GLboolean normalize = GL_TRUE;
+};
+// Half-Precision Floats
+template <>
+struct attribute_pointer_traits<half2> {
+  static constexpr GLenum type = GL_HALF_FLOAT;
+  static constexpr GLint size = 2;
+  static constexpr GLboolean normalize = GL_FALSE;
 };
 
 // Genericly set a vertex attribute pointer according to a given type.
@@ -33,8 +59,8 @@ void set_attribute_pointer(GLuint location,
                            size_t offset) noexcept {
   using traits = attribute_pointer_traits<T>;
   glEnableVertexAttribArray(location);
-  glVertexAttribPointer(location, traits::size, traits::type, GL_FALSE, stride,
-                        (void*)offset);
+  glVertexAttribPointer(location, traits::size, traits::type, traits::normalize,
+                        stride, (void*)offset);
 };
 
 }  // namespace detail
@@ -73,6 +99,26 @@ struct vertex_array_handle : object_handle {
 
     return self;
   }
+
+  // Every attribute of the tuple is read tightly packed
+  // from its own buffer given in the order of the tuple.
+  template <generic::static_layout_tuple tuple_type>
+  auto setup_soa(const auto&... buffers) const noexcept -> binded_handle {
+    static_assert(sizeof...(buffers) == std::tuple_size<tuple_type>::value);
+    const auto self = bind();
+
+    using indices =
+        meta::static_index_list::iota<std::tuple_size<tuple_type>::value>;
+
+    const auto buffer_list = std::forward_as_tuple(buffers...);
+    indices::for_each([&]<size_t index> {
+      using type = typename std::tuple_element<index, tuple_type>::type;
+      std::get<index>(buffer_list).bind();
+      detail::set_attribute_pointer<type>(index, sizeof(type), 0);
+    });
+
+    return self;
+  }
 };
 
 class vertex_array : public vertex_array_handle<> {
@@ -106,6 +106,12 @@ int main(int argc, char* argv[]) {
             // primitive_drawing = !primitive_drawing;
             viewer.preprocess_face_curve();
             break;
+          case sf::Keyboard::G:
+            viewer.preprocess_geodesic_curve();
+            break;
+          case sf::Keyboard::F:
+            viewer.straighten_curve();
+            break;
           case sf::Keyboard::S:
             viewer.smooth_initial_curve();
             break;